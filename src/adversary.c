@@ -0,0 +1,286 @@
+#include <byzantine_orchestra.h>
+
+// What a concert's byzantine musicians do in place of playing honestly. Each
+// strategy may replace the tempo of a pulse, cast a vote with each report
+// and send extra copies of it
+typedef struct {
+    const char *name;
+    // False to play honestly this pulse
+    bool (*tempo)(const orchestra_t *orchestra, const musician_t *musician,
+                  const tempo_t *tempo, double *played_bpm);
+    // False to cast no vote with this report
+    bool (*vote)(const orchestra_t *orchestra, const musician_t *musician,
+                 int sequence, int *target_id, bool *is_negative);
+    int report_copies;
+} adversary_ops_t;
+
+// What each strategy got away with, over every concert that played it
+typedef struct {
+    int concerts;
+    int byzantine;
+    int detected;
+    int changes_detected; // Of those detected, by the change detector
+    int detection_pulses_total;
+    int detection_pulses_max;
+    int honest_blacklisted;
+    uint64_t honest_pulses; // Played by honest musicians, for the false alarm rate
+    uint64_t pulses;
+    uint64_t conductor_cpu_ns;
+    double tempo_error_total;
+    int tempo_beats;
+} adversary_result_t;
+
+static adversary_result_t results[ADVERSARY_COUNT];
+static pthread_mutex_t results_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Byzantine musicians agree on their moves without talking, through a
+// noise sequence they all know: uniform in [0, 1) for a concert, key and pulse
+static double shared_noise(const orchestra_t *orchestra, int key, int sequence) {
+    uint64_t x = orchestra->adversary_seed ^ ((uint64_t)(uint32_t) key << 32) ^ (uint32_t) sequence;
+
+    // splitmix64 finalizer
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// The old behaviour: half the pulses off by BPM_TOLERANCE to
+// BYZANTINE_MAX_DEVIATION either way, each musician on its own
+static bool random_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                         const tempo_t *tempo, double *played_bpm) {
+    if (rand() % 100 >= BYZANTINE_BEHAVIOR_CHANCE * 100) return false;
+
+    *played_bpm = add_variance(tempo->bpm, DEVIATION_BYZANTINE);
+    return true;
+}
+
+// Partners attack on the same pulses by the same amount in the same
+// direction, pulling the tempo together instead of cancelling out
+static bool collude_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                          const tempo_t *tempo, double *played_bpm) {
+    int key = musician->partner_id >= 0 && musician->partner_id < musician->id ?
+              musician->partner_id : musician->id;
+
+    if (shared_noise(orchestra, key, tempo->sequence) >= BYZANTINE_BEHAVIOR_CHANCE) return false;
+
+    double amount = shared_noise(orchestra, key + MAX_ORCHESTRA_SIZE, tempo->sequence);
+    double deviation = BPM_TOLERANCE + amount * (BYZANTINE_MAX_DEVIATION - BPM_TOLERANCE);
+    double sign = shared_noise(orchestra, -1, 0) < 0.5 ? 1.0 : -1.0;
+
+    *played_bpm = tempo->bpm * (1.0 + sign * deviation);
+    return true;
+}
+
+// And vouch for each other
+static bool collude_vote(const orchestra_t *orchestra, const musician_t *musician,
+                         int sequence, int *target_id, bool *is_negative) {
+    if (musician->partner_id < 0) return false;
+
+    *target_id = musician->partner_id;
+    *is_negative = false;
+    return true;
+}
+
+// Every byzantine musician drifts the same way, ramping up to just inside
+// BPM_TOLERANCE, so each report still scores as good
+static bool drift_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                        const tempo_t *tempo, double *played_bpm) {
+    double sign = shared_noise(orchestra, -1, 0) < 0.5 ? 1.0 : -1.0;
+    double ramp = fmin(1.0, (double)(tempo->sequence + 1) / ADVERSARY_DRIFT_PULSES);
+
+    *played_bpm = tempo->bpm *
+                  (1.0 + sign * ADVERSARY_DRIFT_MARGIN * BPM_TOLERANCE * ramp);
+    return true;
+}
+
+// One attack at the largest deviation short of the extreme penalty per
+// REPUTATION_DECAY_PERIOD_NS, playing well for the rest of each period
+static bool on_off_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                         const tempo_t *tempo, double *played_bpm) {
+    long period_pulses = lround(tempo->bpm * REPUTATION_DECAY_PERIOD_NS /
+                                (MICROSECONDS_PER_MINUTE * 1000.0));
+    if (period_pulses < 1) {
+        period_pulses = 1;
+    }
+    if (tempo->sequence % period_pulses != 0) return false;
+
+    double sign = shared_noise(orchestra, musician->id, tempo->sequence) < 0.5 ? 1.0 : -1.0;
+    *played_bpm = tempo->bpm * (1.0 + sign * BYZANTINE_MAX_DEVIATION);
+    return true;
+}
+
+// Play honestly, but every byzantine musician votes against the same honest
+// one each pulse
+static bool false_vote(const orchestra_t *orchestra, const musician_t *musician,
+                       int sequence, int *target_id, bool *is_negative) {
+    int num_musicians = orchestra->num_musicians;
+
+    for (int i = 0; i < num_musicians; i++) {
+        int candidate = (sequence + i) % num_musicians;
+
+        if (!orchestra->musicians[candidate].is_byzantine) {
+            *target_id = candidate;
+            *is_negative = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const adversary_ops_t strategies[ADVERSARY_COUNT] = {
+    [ADVERSARY_NONE] = { "none", NULL, NULL, 1 },
+    [ADVERSARY_RANDOM] = { "random", random_tempo, NULL, 1 },
+    [ADVERSARY_COLLUDE] = { "collude", collude_tempo, collude_vote, 1 },
+    [ADVERSARY_DRIFT] = { "drift", drift_tempo, NULL, 1 },
+    [ADVERSARY_ON_OFF] = { "on-off", on_off_tempo, NULL, 1 },
+    [ADVERSARY_FALSE_VOTES] = { "false-votes", NULL, false_vote, 1 },
+    [ADVERSARY_FLOOD] = { "flood", random_tempo, NULL, ADVERSARY_FLOOD_COPIES }
+};
+
+const char* adversary_name(adversary_strategy_t strategy) {
+    return strategy < ADVERSARY_COUNT ? strategies[strategy].name : "all";
+}
+
+// --adversary all gives each concert the next strategy in turn
+adversary_strategy_t concert_adversary(int concert_id) {
+    if (adversary_strategy == ADVERSARY_COUNT) {
+        return (adversary_strategy_t)(concert_id % ADVERSARY_COUNT);
+    }
+    return adversary_strategy;
+}
+
+// Byzantine musicians collude in pairs in id order, one left over plays alone
+void pair_byzantine_musicians(orchestra_t *orchestra) {
+    musician_t *musicians = orchestra->musicians;
+    int unpaired = -1;
+
+    orchestra->adversary_seed = ((uint64_t) rand() << 32) ^ (uint64_t) rand();
+
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        musicians[i].partner_id = -1;
+        if (!musicians[i].is_byzantine) continue;
+
+        if (unpaired < 0) {
+            unpaired = i;
+        } else {
+            musicians[i].partner_id = unpaired;
+            musicians[unpaired].partner_id = i;
+            unpaired = -1;
+        }
+    }
+}
+
+bool adversary_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                     const tempo_t *tempo, double *played_bpm) {
+    const adversary_ops_t *ops = &strategies[orchestra->adversary];
+
+    if (!musician->is_byzantine || ops->tempo == NULL) return false;
+    return ops->tempo(orchestra, musician, tempo, played_bpm);
+}
+
+int adversary_report_copies(const orchestra_t *orchestra, const musician_t *musician) {
+    return musician->is_byzantine ? strategies[orchestra->adversary].report_copies : 1;
+}
+
+// Sent with the report, on the connection the report went out on
+void send_adversary_vote(orchestra_t *orchestra, const musician_t *musician,
+                         int sequence, int coid) {
+    const adversary_ops_t *ops = &strategies[orchestra->adversary];
+    int target_id;
+    bool is_negative;
+
+    if (!musician->is_byzantine || ops->vote == NULL ||
+        !ops->vote(orchestra, musician, sequence, &target_id, &is_negative)) {
+        return;
+    }
+
+    vote_msg_t vote = { .target_id = target_id, .is_negative = is_negative };
+    init_msg_header(&vote.header, MSG_VOTE, musician->id, sequence);
+
+    if (send_message(coid, &vote.header, sizeof(vote), 1) == -1 &&
+        program_running && orchestra->playing) {
+        printf("%s: Could not send vote: %s\n", musician->name, strerror(errno));
+    }
+}
+
+// Called by the conductor as its concert ends
+void adversary_finish_concert(orchestra_t *orchestra, uint64_t conductor_cpu_ns) {
+    adversary_result_t *result = &results[orchestra->adversary];
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+    pthread_mutex_lock(&results_mutex);
+
+    result->concerts++;
+    result->pulses += orchestra->pulses_sent;
+    result->conductor_cpu_ns += conductor_cpu_ns;
+    result->tempo_error_total += orchestra->tempo_window.error_total;
+    result->tempo_beats += orchestra->tempo_window.beats;
+
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        int detected_at = orchestra->standings[i].detected_at;
+
+        if (!orchestra->musicians[i].is_byzantine) {
+            result->honest_blacklisted += detected_at >= 0;
+            result->honest_pulses += orchestra->pulses_sent;
+            continue;
+        }
+
+        result->byzantine++;
+        if (detected_at >= 0) {
+            result->detected++;
+            result->changes_detected += orchestra->standings[i].detector_alarmed;
+            result->detection_pulses_total += detected_at;
+            if (detected_at > result->detection_pulses_max) {
+                result->detection_pulses_max = detected_at;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&results_mutex);
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+}
+
+// Detection latency counts pulses from the start of the concert, conductor
+// time is its thread's CPU time compared with the honest concerts
+void print_adversary_summary() {
+    pthread_mutex_lock(&results_mutex);
+
+    const adversary_result_t *baseline = &results[ADVERSARY_NONE];
+    double baseline_us = baseline->pulses > 0 ?
+                         baseline->conductor_cpu_ns / 1000.0 / baseline->pulses : 0.0;
+
+    printf("\nAdversary benchmark\n");
+    for (int s = 0; s < ADVERSARY_COUNT; s++) {
+        const adversary_result_t *result = &results[s];
+        if (result->concerts == 0) continue;
+
+        double conductor_us = result->pulses > 0 ?
+                              result->conductor_cpu_ns / 1000.0 / result->pulses : 0.0;
+
+        printf("%s: %d of %d byzantine caught", strategies[s].name,
+               result->detected, result->byzantine);
+        if (result->detected > 0) {
+            printf(" after mean %.1f pulses, max %d",
+                   (double) result->detection_pulses_total / result->detected,
+                   result->detection_pulses_max);
+            if (detector_mode == DETECTOR_CUSUM) {
+                printf(" (%d by change detection)", result->changes_detected);
+            }
+        }
+        printf(", %d honest blacklisted (%.1e per honest musician pulse)",
+               result->honest_blacklisted,
+               result->honest_pulses > 0 ?
+               (double) result->honest_blacklisted / result->honest_pulses : 0.0);
+        printf(", tempo error %.2f%%, conductor %.1f us/pulse",
+               result->tempo_beats > 0 ? result->tempo_error_total / result->tempo_beats * 100.0 : 0.0,
+               conductor_us);
+        if (s != ADVERSARY_NONE && baseline_us > 0) {
+            printf(" (%+.0f%%)", (conductor_us / baseline_us - 1.0) * 100.0);
+        }
+        printf(" over %d concerts\n", result->concerts);
+    }
+
+    pthread_mutex_unlock(&results_mutex);
+}
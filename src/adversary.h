@@ -0,0 +1,21 @@
+#ifndef ADVERSARY_H
+#define ADVERSARY_H
+
+// Copies of each report a flooding musician sends
+#define ADVERSARY_FLOOD_COPIES 8
+// Share of BPM_TOLERANCE a drifting musician ends up at, and the pulses it takes
+#define ADVERSARY_DRIFT_MARGIN 0.9
+#define ADVERSARY_DRIFT_PULSES 16
+
+const char* adversary_name(adversary_strategy_t strategy);
+adversary_strategy_t concert_adversary(int concert_id);
+void pair_byzantine_musicians(orchestra_t *orchestra);
+bool adversary_tempo(const orchestra_t *orchestra, const musician_t *musician,
+                     const tempo_t *tempo, double *played_bpm);
+int adversary_report_copies(const orchestra_t *orchestra, const musician_t *musician);
+void send_adversary_vote(orchestra_t *orchestra, const musician_t *musician,
+                         int sequence, int coid);
+void adversary_finish_concert(orchestra_t *orchestra, uint64_t conductor_cpu_ns);
+void print_adversary_summary();
+
+#endif
@@ -0,0 +1,602 @@
+#include <byzantine_orchestra.h>
+
+// Musicians post their note onsets to a lock-free queue. One mixer thread
+// turns them into decaying sine voices, mixes a block every 5.3 ms, and
+// passes it to the sink thread through a lock-free ring. Nothing on the path
+// from a note to the sink takes a lock, so a slow disk never holds up a
+// musician or the mixer
+
+typedef struct {
+    uint64_t onset_ns; // When it was played
+    uint64_t nominal_ns; // When the conductor's beat fell
+    float frequency;
+    float bpm;
+} note_event_t;
+
+// Bounded multi-producer queue, a slot is free for the producer at position
+// p when its sequence is p and ready for the mixer when it is p + 1
+typedef struct {
+    uint32_t sequence;
+    note_event_t event;
+} event_slot_t;
+
+// GCC vector extensions, four floats to fit the SSE or NEON registers every
+// QNX target has. Voices are mixed four at a time, one per lane
+#define VOICE_LANES 4
+typedef float voice_vec_t __attribute__((vector_size(VOICE_LANES * sizeof(float))));
+typedef int32_t voice_mask_t __attribute__((vector_size(VOICE_LANES * sizeof(int32_t))));
+
+// Each oscillator is a unit vector rotated by a fixed step every frame
+typedef struct {
+    voice_vec_t re;
+    voice_vec_t im;
+    voice_vec_t step_re;
+    voice_vec_t step_im;
+    voice_vec_t gain;
+    voice_vec_t decay; // Per frame, down to -60 dB over one beat
+    voice_vec_t start; // Frames into the block before the note sounds
+} voice_group_t;
+
+typedef enum {
+    SINK_NULL,
+    SINK_WAV,
+    SINK_RAW // Bare 16-bit samples, for a FIFO or device
+} sink_kind_t;
+
+typedef struct {
+    uint64_t blocks;
+    uint64_t mix_ns_total;
+    uint64_t mix_ns_max;
+    int peak_voices;
+    uint64_t notes;
+    uint64_t late_notes; // Arrived after their block was mixed
+    uint64_t voices_dropped; // Every voice in use
+    uint64_t blocks_dropped; // Sink ring full
+    double onset_error_total;
+    double onset_error_squares;
+    double onset_error_max;
+    uint64_t frames_written;
+} audio_stats_t;
+
+typedef struct __attribute__((packed)) {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data[4];
+    uint32_t data_size;
+} wav_header_t;
+
+static event_slot_t event_slots[AUDIO_EVENT_RING];
+static uint32_t event_head = 0; // Claimed by producers
+static uint32_t event_tail = 0; // Mixer only
+static uint64_t notes_dropped = 0; // Event ring full, counted atomically
+
+static int16_t audio_blocks[AUDIO_RING_BLOCKS][AUDIO_BLOCK_FRAMES];
+static uint32_t blocks_written = 0; // Mixer only, read by the sink
+static uint32_t blocks_read = 0; // Sink only, read by the mixer
+
+// The mixer is paced on a condition variable so shutdown can wake it
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    volatile bool running;
+    bool started;
+    uint64_t start_ns;
+    voice_group_t *groups;
+    int voice_count;
+    int voice_capacity;
+    float voice_gain;
+} mixer = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+    pthread_t thread;
+    sem_t ready; // Posted for each block mixed, and once more to stop
+    volatile bool running;
+    sink_kind_t kind;
+    const char *path;
+    int fd;
+} sink;
+
+static audio_stats_t stats;
+
+static uint64_t frames_to_ns(uint64_t frames) {
+    return frames * 1000000000ULL / AUDIO_SAMPLE_RATE;
+}
+
+static int64_t ns_to_frames(int64_t ns) {
+    return (int64_t) llround((double) ns * AUDIO_SAMPLE_RATE / 1e9);
+}
+
+// Scientific pitch names such as "F#4" or "Bb3", 0 for anything else
+static float note_frequency(const char *note) {
+    static const int semitones[7] = { 9, 11, 0, 2, 4, 5, 7 }; // A to G from C
+
+    if (note[0] < 'A' || note[0] > 'G') return 0.0f;
+
+    int semitone = semitones[note[0] - 'A'];
+    const char *p = note + 1;
+
+    if (*p == '#') {
+        semitone++;
+        p++;
+    } else if (*p == 'b') {
+        semitone--;
+        p++;
+    }
+
+    char *end;
+    long octave = strtol(p, &end, 10);
+    if (end == p || *end != '\0') return 0.0f;
+
+    int midi_note = (int)(octave + 1) * 12 + semitone;
+    return 440.0f * powf(2.0f, (midi_note - 69) / 12.0f);
+}
+
+// Producer side, called from any musician thread or executor worker
+void audio_note_on(const orchestra_t *orchestra, const char *note, double bpm, int sequence) {
+    if (!mixer.running) return;
+
+    note_event_t event = {
+        .onset_ns = monotonic_time_ns(),
+        .nominal_ns = orchestra->beat_onsets_ns[sequence % BEAT_HISTORY],
+        .frequency = note_frequency(note),
+        .bpm = bpm
+    };
+    if (event.frequency <= 0.0f) return;
+
+    uint32_t position = __atomic_load_n(&event_head, __ATOMIC_RELAXED);
+    event_slot_t *slot;
+
+    for (;;) {
+        slot = &event_slots[position % AUDIO_EVENT_RING];
+        uint32_t sequence_now = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int32_t difference = (int32_t)(sequence_now - position);
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&event_head, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // The mixer is a whole ring behind
+            __atomic_add_fetch(&notes_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            position = __atomic_load_n(&event_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->event = event;
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+static bool take_note_event(note_event_t *event) {
+    event_slot_t *slot = &event_slots[event_tail % AUDIO_EVENT_RING];
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != event_tail + 1) {
+        return false;
+    }
+
+    *event = slot->event;
+    __atomic_store_n(&slot->sequence, event_tail + AUDIO_EVENT_RING, __ATOMIC_RELEASE);
+    event_tail++;
+    return true;
+}
+
+// Mixer side, voices are kept packed so the first voice_count are in use
+
+static void start_voice(const note_event_t *event, uint64_t block_frame) {
+    int64_t frame = ns_to_frames((int64_t)(event->onset_ns - mixer.start_ns));
+
+    // Placed where it was played, unless its block has already been mixed
+    if (frame < (int64_t) block_frame) {
+        frame = block_frame;
+        stats.late_notes++;
+    }
+
+    // Onset error as heard, in whole frames from the conductor's beat
+    if (event->nominal_ns != 0) {
+        double error = (double)(frame - ns_to_frames((int64_t)(event->nominal_ns - mixer.start_ns)));
+        stats.notes++;
+        stats.onset_error_total += error;
+        stats.onset_error_squares += error * error;
+        if (fabs(error) > stats.onset_error_max) {
+            stats.onset_error_max = fabs(error);
+        }
+    }
+
+    if (mixer.voice_count == mixer.voice_capacity) {
+        stats.voices_dropped++;
+        return;
+    }
+
+    int voice = mixer.voice_count++;
+    voice_group_t *group = &mixer.groups[voice / VOICE_LANES];
+    int lane = voice % VOICE_LANES;
+    double step = 2.0 * M_PI * event->frequency / AUDIO_SAMPLE_RATE;
+    double beat_frames = 60.0 * AUDIO_SAMPLE_RATE / event->bpm;
+
+    group->re[lane] = 0.0f;
+    group->im[lane] = 1.0f;
+    group->step_re[lane] = (float) cos(step);
+    group->step_im[lane] = (float) sin(step);
+    group->gain[lane] = mixer.voice_gain;
+    group->decay[lane] = (float) exp(log(0.001) / beat_frames);
+    group->start[lane] = (float)(frame - (int64_t) block_frame);
+
+    if (mixer.voice_count > stats.peak_voices) {
+        stats.peak_voices = mixer.voice_count;
+    }
+}
+
+static void copy_lane(voice_group_t *to, int to_lane, const voice_group_t *from, int from_lane) {
+    to->re[to_lane] = from->re[from_lane];
+    to->im[to_lane] = from->im[from_lane];
+    to->step_re[to_lane] = from->step_re[from_lane];
+    to->step_im[to_lane] = from->step_im[from_lane];
+    to->gain[to_lane] = from->gain[from_lane];
+    to->decay[to_lane] = from->decay[from_lane];
+    to->start[to_lane] = from->start[from_lane];
+}
+
+// Silent voices are replaced by the last one, which is left silent in turn
+static void retire_voices() {
+    for (int voice = 0; voice < mixer.voice_count; ) {
+        voice_group_t *group = &mixer.groups[voice / VOICE_LANES];
+        int lane = voice % VOICE_LANES;
+
+        if (group->gain[lane] >= AUDIO_SILENCE || group->start[lane] > 0.0f) {
+            voice++;
+            continue;
+        }
+
+        int last = --mixer.voice_count;
+        voice_group_t *last_group = &mixer.groups[last / VOICE_LANES];
+        copy_lane(group, lane, last_group, last % VOICE_LANES);
+        last_group->gain[last % VOICE_LANES] = 0.0f;
+        last_group->start[last % VOICE_LANES] = 0.0f;
+    }
+}
+
+static voice_vec_t select_lanes(voice_mask_t mask, voice_vec_t if_set, voice_vec_t if_clear) {
+    return (voice_vec_t)((mask & (voice_mask_t) if_set) | (~mask & (voice_mask_t) if_clear));
+}
+
+// Lanes of every voice group are summed per frame, and only across lanes
+// once per frame at the end
+static void mix_block(float *mixed) {
+    voice_vec_t sums[AUDIO_BLOCK_FRAMES];
+    const voice_vec_t zero = { 0 };
+    const voice_vec_t block = zero + (float) AUDIO_BLOCK_FRAMES;
+    int groups = (mixer.voice_count + VOICE_LANES - 1) / VOICE_LANES;
+
+    for (int f = 0; f < AUDIO_BLOCK_FRAMES; f++) {
+        sums[f] = zero;
+    }
+
+    for (int g = 0; g < groups; g++) {
+        voice_group_t *group = &mixer.groups[g];
+        voice_vec_t re = group->re;
+        voice_vec_t im = group->im;
+        voice_vec_t gain = group->gain;
+        voice_vec_t frame = zero;
+
+        for (int f = 0; f < AUDIO_BLOCK_FRAMES; f++) {
+            voice_mask_t sounding = frame >= group->start;
+
+            sums[f] += select_lanes(sounding, gain * re, zero);
+            gain = select_lanes(sounding, gain * group->decay, gain);
+
+            voice_vec_t next_re = re * group->step_re - im * group->step_im;
+            im = re * group->step_im + im * group->step_re;
+            re = next_re;
+            frame += 1.0f;
+        }
+
+        // One Newton step keeps the rotation on the unit circle
+        voice_vec_t correction = (3.0f - (re * re + im * im)) * 0.5f;
+        group->re = re * correction;
+        group->im = im * correction;
+        group->gain = gain;
+        group->start = select_lanes(group->start > block, group->start - block, zero);
+    }
+
+    for (int f = 0; f < AUDIO_BLOCK_FRAMES; f++) {
+        float sum = 0.0f;
+        for (int lane = 0; lane < VOICE_LANES; lane++) {
+            sum += sums[f][lane];
+        }
+        mixed[f] = sum;
+    }
+}
+
+// Hand a block to the sink, dropping it rather than waiting if the sink is behind
+static void publish_block(const float *mixed) {
+    if (blocks_written - __atomic_load_n(&blocks_read, __ATOMIC_ACQUIRE) == AUDIO_RING_BLOCKS) {
+        stats.blocks_dropped++;
+        return;
+    }
+
+    int16_t *samples = audio_blocks[blocks_written % AUDIO_RING_BLOCKS];
+    for (int f = 0; f < AUDIO_BLOCK_FRAMES; f++) {
+        float sample = fminf(fmaxf(mixed[f], -1.0f), 1.0f);
+        samples[f] = (int16_t) lrintf(sample * 32767.0f);
+    }
+
+    __atomic_store_n(&blocks_written, blocks_written + 1, __ATOMIC_RELEASE);
+    sem_post(&sink.ready);
+}
+
+static void* mixer_thread(void *unused_arg) {
+    uint64_t block_frame = 0;
+    float mixed[AUDIO_BLOCK_FRAMES];
+    profile_thread(ROLE_AUDIO);
+
+    pthread_mutex_lock(&mixer.lock);
+    while (mixer.running) {
+        uint64_t due_ns = mixer.start_ns + frames_to_ns(block_frame + AUDIO_BLOCK_FRAMES) +
+                          AUDIO_LATENCY_NS;
+
+        if (monotonic_time_ns() < due_ns) {
+            struct timespec deadline = {
+                .tv_sec = due_ns / 1000000000ULL,
+                .tv_nsec = due_ns % 1000000000ULL
+            };
+            pthread_cond_timedwait(&mixer.wake, &mixer.lock, &deadline);
+            continue;
+        }
+        pthread_mutex_unlock(&mixer.lock);
+
+        uint64_t mix_start_ns = monotonic_time_ns();
+        note_event_t event;
+
+        while (take_note_event(&event)) {
+            start_voice(&event, block_frame);
+        }
+        mix_block(mixed);
+        retire_voices();
+        publish_block(mixed);
+
+        uint64_t mix_ns = monotonic_time_ns() - mix_start_ns;
+        stats.blocks++;
+        stats.mix_ns_total += mix_ns;
+        if (mix_ns > stats.mix_ns_max) {
+            stats.mix_ns_max = mix_ns;
+        }
+        block_frame += AUDIO_BLOCK_FRAMES;
+        sample_thread_cpu(NULL);
+
+        pthread_mutex_lock(&mixer.lock);
+    }
+    pthread_mutex_unlock(&mixer.lock);
+
+    return NULL;
+}
+
+// Sink side
+
+static int write_samples(const void *data, size_t bytes) {
+    const char *p = data;
+
+    while (bytes > 0) {
+        ssize_t written = write(sink.fd, p, bytes);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += written;
+        bytes -= written;
+    }
+    return 0;
+}
+
+static void fill_wav_header(wav_header_t *header, uint32_t data_bytes) {
+    memcpy(header->riff, "RIFF", 4);
+    header->riff_size = sizeof(*header) - 8 + data_bytes;
+    memcpy(header->wave, "WAVE", 4);
+    memcpy(header->fmt, "fmt ", 4);
+    header->fmt_size = 16;
+    header->format = 1; // PCM
+    header->channels = 1;
+    header->sample_rate = AUDIO_SAMPLE_RATE;
+    header->byte_rate = AUDIO_SAMPLE_RATE * sizeof(int16_t);
+    header->block_align = sizeof(int16_t);
+    header->bits_per_sample = 16;
+    memcpy(header->data, "data", 4);
+    header->data_size = data_bytes;
+}
+
+static void* sink_thread(void *unused_arg) {
+    bool failed = false;
+    profile_thread(ROLE_AUDIO);
+
+    for (;;) {
+        while (sem_wait(&sink.ready) == -1 && errno == EINTR) {
+        }
+
+        uint32_t available = __atomic_load_n(&blocks_written, __ATOMIC_ACQUIRE);
+        while (blocks_read != available) {
+            const int16_t *samples = audio_blocks[blocks_read % AUDIO_RING_BLOCKS];
+
+            if (sink.kind != SINK_NULL && !failed &&
+                write_samples(samples, sizeof(audio_blocks[0])) == -1) {
+                printf("Could not write audio to %s: %s\n", sink.path, strerror(errno));
+                failed = true;
+            }
+            stats.frames_written += failed ? 0 : AUDIO_BLOCK_FRAMES;
+            __atomic_store_n(&blocks_read, blocks_read + 1, __ATOMIC_RELEASE);
+        }
+        sample_thread_cpu(NULL);
+
+        if (!sink.running) break;
+    }
+
+    return NULL;
+}
+
+static int open_sink(const char *path) {
+    size_t length = strlen(path);
+
+    sink.path = path;
+    sink.fd = -1;
+
+    if (strcmp(path, "null") == 0) {
+        sink.kind = SINK_NULL;
+        return 0;
+    }
+    sink.kind = length > 4 && strcmp(path + length - 4, ".wav") == 0 ? SINK_WAV : SINK_RAW;
+
+    // A FIFO blocks here until something reads it
+    sink.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (sink.fd == -1) {
+        printf("Could not open audio sink %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    // Sizes are filled in once the audio is finished
+    if (sink.kind == SINK_WAV) {
+        wav_header_t header;
+        fill_wav_header(&header, 0);
+        if (write_samples(&header, sizeof(header)) == -1) {
+            printf("Could not write audio to %s: %s\n", path, strerror(errno));
+            close(sink.fd);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void close_sink() {
+    if (sink.fd == -1) return;
+
+    if (sink.kind == SINK_WAV) {
+        wav_header_t header;
+        fill_wav_header(&header, stats.frames_written * sizeof(int16_t));
+        if (pwrite(sink.fd, &header, sizeof(header), 0) != sizeof(header)) {
+            printf("Could not finish %s: %s\n", sink.path, strerror(errno));
+        }
+    }
+    close(sink.fd);
+    sink.fd = -1;
+}
+
+// voices is the number of musicians that may sound at once, a note rings
+// for about a beat
+int start_audio(const char *path, int voices) {
+    if (open_sink(path) != 0) {
+        return -1;
+    }
+
+    // Room for each musician's note to overlap the next one
+    mixer.voice_capacity = (2 * voices + VOICE_LANES - 1) / VOICE_LANES * VOICE_LANES;
+    mixer.voice_count = 0;
+    mixer.voice_gain = AUDIO_HEADROOM / sqrtf((float) voices);
+    if (posix_memalign((void**) &mixer.groups, CACHE_LINE_SIZE,
+                       mixer.voice_capacity / VOICE_LANES * sizeof(voice_group_t)) != 0) {
+        printf("Could not allocate %d audio voices\n", mixer.voice_capacity);
+        close_sink();
+        return -1;
+    }
+    memset(mixer.groups, 0, mixer.voice_capacity / VOICE_LANES * sizeof(voice_group_t));
+
+    for (uint32_t i = 0; i < AUDIO_EVENT_RING; i++) {
+        event_slots[i].sequence = i;
+    }
+    memset(&stats, 0, sizeof(stats));
+
+    sem_init(&sink.ready, 0, 0);
+    sink.running = true;
+    if (start_thread(&sink.thread, NULL, sink_thread, NULL) != 0) {
+        perror("Could not create audio sink thread");
+        sem_destroy(&sink.ready);
+        free(mixer.groups);
+        close_sink();
+        return -1;
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&mixer.wake, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    mixer.start_ns = monotonic_time_ns();
+    mixer.running = true;
+    mixer.started = true;
+    if (start_thread(&mixer.thread, NULL, mixer_thread, NULL) != 0) {
+        perror("Could not create audio mixer thread");
+        mixer.running = false;
+        mixer.started = false;
+        pthread_cond_destroy(&mixer.wake);
+        stop_audio();
+        return -1;
+    }
+
+    printf("Mixing up to %d voices at %d Hz to %s\n", mixer.voice_capacity, AUDIO_SAMPLE_RATE, path);
+    return 0;
+}
+
+// Stop mixing, then let the sink write what is left and finish the file
+void stop_audio() {
+    if (mixer.started) {
+        pthread_mutex_lock(&mixer.lock);
+        mixer.running = false;
+        pthread_cond_signal(&mixer.wake);
+        pthread_mutex_unlock(&mixer.lock);
+
+        if (join_thread(mixer.thread, "Audio mixer") != 0) {
+            return;
+        }
+        mixer.started = false;
+        pthread_cond_destroy(&mixer.wake);
+    }
+
+    if (!sink.running) return;
+
+    sink.running = false;
+    sem_post(&sink.ready);
+    if (join_thread(sink.thread, "Audio sink") != 0) {
+        return;
+    }
+    sem_destroy(&sink.ready);
+    close_sink();
+    free(mixer.groups);
+    mixer.groups = NULL;
+}
+
+void print_audio_summary() {
+    if (stats.blocks == 0) return;
+
+    double block_us = frames_to_ns(AUDIO_BLOCK_FRAMES) / 1000.0;
+    double mix_mean_us = stats.mix_ns_total / 1000.0 / stats.blocks;
+
+    printf("Audio mix: %llu blocks of %d frames at %d Hz, mean %.1f us, max %.1f us per %.0f us block (%.1f%% of real time), peak %d voices\n",
+           (unsigned long long) stats.blocks, AUDIO_BLOCK_FRAMES, AUDIO_SAMPLE_RATE,
+           mix_mean_us, stats.mix_ns_max / 1000.0, block_us, mix_mean_us / block_us * 100.0,
+           stats.peak_voices);
+    printf("Audio written: %.1f s to %s\n",
+           (double) stats.frames_written / AUDIO_SAMPLE_RATE, sink.path);
+
+    if (stats.notes > 0) {
+        double mean = stats.onset_error_total / stats.notes;
+        printf("Audio onset error from the conductor's beat: mean %+.1f, RMS %.1f, max %.0f samples over %llu notes, %llu placed late\n",
+               mean, sqrt(stats.onset_error_squares / stats.notes), stats.onset_error_max,
+               (unsigned long long) stats.notes, (unsigned long long) stats.late_notes);
+    }
+
+    uint64_t dropped = __atomic_load_n(&notes_dropped, __ATOMIC_RELAXED);
+    if (dropped > 0 || stats.voices_dropped > 0 || stats.blocks_dropped > 0) {
+        printf("Audio dropped: %llu notes with the queue full, %llu with every voice in use, %llu blocks with the sink behind\n",
+               (unsigned long long) dropped, (unsigned long long) stats.voices_dropped,
+               (unsigned long long) stats.blocks_dropped);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BLOCK_FRAMES 256 // 5.3 ms at AUDIO_SAMPLE_RATE
+// The mixer renders this far behind real time, so a note reaches it before
+// the block it starts in is mixed
+#define AUDIO_LATENCY_NS 20000000ULL
+// Notes waiting for the mixer, and mixed blocks waiting for the sink, powers of two
+#define AUDIO_EVENT_RING 8192
+#define AUDIO_RING_BLOCKS 64
+// Peak level of the mix, shared out between the voices
+#define AUDIO_HEADROOM 0.5f
+// A voice this quiet is retired, -80 dB
+#define AUDIO_SILENCE 0.0001f
+
+int start_audio(const char *sink, int voices);
+void audio_note_on(const orchestra_t *orchestra, const char *note, double bpm, int sequence);
+void stop_audio();
+void print_audio_summary();
+
+#endif
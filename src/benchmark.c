@@ -0,0 +1,210 @@
+#include <byzantine_orchestra.h>
+
+// Microbenchmark of the conductor's batch scoring, run with
+// --benchmark-scoring. One pulse's reports are scored in REPORT_BATCH_MAX
+// chunks by score_behaviours and apply_behaviour_scores, as the conductor
+// does, and one at a time by calculate_behaviour_score and
+// update_reputation, as it did before. Each path has an orchestra of its
+// own, reset to the same standings before every round. Sizes past
+// MAX_ORCHESTRA_SIZE wrap around its musicians, whose later reports decay
+// their reputations over the time between them, slightly differently on
+// each path
+
+typedef struct {
+    int count;
+    int *musician_ids;
+    double *reported_bpm;
+    double *expected_bpm;
+    double *scores;
+    double *deviations;
+} report_arrays_t;
+
+static int setup_orchestra(orchestra_t *orchestra, int num_musicians) {
+    orchestra->num_musicians = num_musicians;
+    orchestra->conductor_bpm = DEFAULT_BPM;
+    pthread_mutex_init(&orchestra->reputation_mutex, NULL);
+
+    orchestra->musicians = calloc(num_musicians, sizeof(musician_t));
+    orchestra->standings = calloc(num_musicians, sizeof(standing_t));
+    if (orchestra->musicians == NULL || orchestra->standings == NULL) {
+        perror("Could not allocate benchmark orchestra");
+        return -1;
+    }
+    return 0;
+}
+
+static void cleanup_orchestra(orchestra_t *orchestra) {
+    cleanup_reputation_system(orchestra);
+    free(orchestra->musicians);
+    free(orchestra->standings);
+}
+
+// Decay is held off until each musician's first report, so both paths
+// start from the same reputations however long after the reset they run
+static void reset_standings(orchestra_t *orchestra) {
+    initialize_reputation_system(orchestra);
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        orchestra->standings[i].reputation_time_ns = UINT64_MAX;
+    }
+}
+
+// Every third musician plays as the random adversary does, deviating by
+// BPM_TOLERANCE to past BYZANTINE_MAX_DEVIATION on half its reports, the
+// rest within BPM_TOLERANCE. The same seed gives the same reports every run
+static int generate_reports(report_arrays_t *reports, int count, int num_musicians) {
+    unsigned int seed = 1;
+
+    reports->count = count;
+    reports->musician_ids = malloc(count * sizeof(int));
+    reports->reported_bpm = malloc(count * sizeof(double));
+    reports->expected_bpm = malloc(count * sizeof(double));
+    reports->scores = malloc(count * sizeof(double));
+    reports->deviations = malloc(count * sizeof(double));
+    if (reports->musician_ids == NULL || reports->reported_bpm == NULL ||
+        reports->expected_bpm == NULL || reports->scores == NULL ||
+        reports->deviations == NULL) {
+        perror("Could not allocate benchmark reports");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int musician_id = i % num_musicians;
+        double deviation = BPM_TOLERANCE * (2.0 * rand_r(&seed) / RAND_MAX - 1.0);
+
+        if (musician_id % 3 == 0 && rand_r(&seed) % 2 == 0) {
+            double size = BPM_TOLERANCE + (1.5 * BYZANTINE_MAX_DEVIATION - BPM_TOLERANCE) *
+                          rand_r(&seed) / RAND_MAX;
+            deviation = rand_r(&seed) % 2 == 0 ? size : -size;
+        }
+
+        reports->musician_ids[i] = musician_id;
+        reports->expected_bpm[i] = DEFAULT_BPM * (0.9 + 0.2 * rand_r(&seed) / RAND_MAX);
+        reports->reported_bpm[i] = reports->expected_bpm[i] * (1.0 + deviation);
+    }
+    return 0;
+}
+
+static void free_reports(report_arrays_t *reports) {
+    free(reports->musician_ids);
+    free(reports->reported_bpm);
+    free(reports->expected_bpm);
+    free(reports->scores);
+    free(reports->deviations);
+}
+
+// A blacklisted musician's reports are shadow-scored by the conductor
+// instead, and only while on probation, so they are skipped here
+static void score_each(orchestra_t *orchestra, const report_arrays_t *reports) {
+    for (int i = 0; i < reports->count; i++) {
+        int musician_id = reports->musician_ids[i];
+        if (orchestra->standings[musician_id].is_blacklisted) continue;
+
+        double behaviour_score = calculate_behaviour_score(reports->reported_bpm[i],
+                                                           reports->expected_bpm[i]);
+        update_reputation(orchestra, musician_id, behaviour_score * 0.5);
+    }
+}
+
+static void score_batched(orchestra_t *orchestra, report_arrays_t *reports) {
+    for (int i = 0; i < reports->count; i += REPORT_BATCH_MAX) {
+        int count = reports->count - i < REPORT_BATCH_MAX ? reports->count - i : REPORT_BATCH_MAX;
+
+        score_behaviours(&reports->reported_bpm[i], &reports->expected_bpm[i],
+                         &reports->scores[i], &reports->deviations[i], count);
+        apply_behaviour_scores(orchestra, &reports->musician_ids[i], &reports->scores[i],
+                               &reports->deviations[i], 0.5, count);
+    }
+}
+
+// Times both paths over the reports and checks they agree, 0 if they do
+static int compare_paths(orchestra_t *each, orchestra_t *batched, report_arrays_t *reports) {
+    int count = reports->count;
+    int num_musicians = each->num_musicians;
+    int rounds = count < SCORING_BENCHMARK_REPORTS ? SCORING_BENCHMARK_REPORTS / count : 1;
+
+    uint64_t each_ns = 0;
+    uint64_t batched_ns = 0;
+    for (int round = 0; round < rounds; round++) {
+        reset_standings(each);
+        reset_standings(batched);
+
+        uint64_t start_ns = monotonic_time_ns();
+        score_each(each, reports);
+        each_ns += monotonic_time_ns() - start_ns;
+
+        start_ns = monotonic_time_ns();
+        score_batched(batched, reports);
+        batched_ns += monotonic_time_ns() - start_ns;
+    }
+
+    // The kernel's scores against the scalar ones, bit for bit, and the
+    // standings both paths left
+    int score_mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        double behaviour_score = calculate_behaviour_score(reports->reported_bpm[i],
+                                                           reports->expected_bpm[i]);
+        if (memcmp(&behaviour_score, &reports->scores[i], sizeof(double)) != 0) {
+            score_mismatches++;
+        }
+    }
+
+    double max_difference = 0.0;
+    int blacklist_mismatches = 0;
+    for (int i = 0; i < num_musicians; i++) {
+        max_difference = fmax(max_difference, fabs(each->standings[i].reputation -
+                                                    batched->standings[i].reputation));
+        if (each->standings[i].is_blacklisted != batched->standings[i].is_blacklisted) {
+            blacklist_mismatches++;
+        }
+    }
+
+    double each_us = each_ns / 1000.0 / rounds;
+    double batched_us = batched_ns / 1000.0 / rounds;
+    printf("%8d %10.1f us %10.1f us %7.1fx %8d   %d scores and %d blacklistings differ, "
+           "max reputation difference %.2g\n",
+           count, each_us, batched_us, batched_us > 0 ? each_us / batched_us : 0.0, rounds,
+           score_mismatches, blacklist_mismatches, max_difference);
+
+    return score_mismatches == 0 && blacklist_mismatches == 0 ? 0 : -1;
+}
+
+static int benchmark_size(int count) {
+    int num_musicians = count < MAX_ORCHESTRA_SIZE ? count : MAX_ORCHESTRA_SIZE;
+    orchestra_t each = {0};
+    orchestra_t batched = {0};
+    report_arrays_t reports = {0};
+    int result = -1;
+
+    if (setup_orchestra(&each, num_musicians) == 0 &&
+        setup_orchestra(&batched, num_musicians) == 0 &&
+        generate_reports(&reports, count, num_musicians) == 0) {
+        result = compare_paths(&each, &batched, &reports);
+    }
+
+    free_reports(&reports);
+    cleanup_orchestra(&each);
+    cleanup_orchestra(&batched);
+    return result;
+}
+
+int run_scoring_benchmark() {
+    const int sizes[] = SCORING_BENCHMARK_SIZES;
+    int result = 0;
+
+    // update_reputation feeds no change detector, so reputation alone
+    // judges both paths
+    detector_mode_t mode = detector_mode;
+    detector_mode = DETECTOR_REPUTATION;
+
+    printf("Scoring a pulse of reports one at a time and in batches of %d, mean per pulse\n",
+           REPORT_BATCH_MAX);
+    printf("%8s %13s %13s %8s %8s\n", "reports", "scalar", "batched", "speedup", "rounds");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (benchmark_size(sizes[i]) != 0) {
+            result = -1;
+        }
+    }
+
+    detector_mode = mode;
+    return result;
+}
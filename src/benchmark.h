@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Reports a pulse the scoring microbenchmark runs at, and the reports each
+// size scores in all over its rounds
+#define SCORING_BENCHMARK_SIZES { 7, 1000, 100000 }
+#define SCORING_BENCHMARK_REPORTS 2000000
+
+int run_scoring_benchmark();
+
+#endif
@@ -2,11 +2,27 @@
 #define BYZANTINE_ORCHESTRA_H
 
 #include "common.h"
+#include "protocol.h"
+#include "tempo.h"
+#include "timing_wheel.h"
+#include "telemetry.h"
 #include "conductor.h"
 #include "musician.h"
 #include "io.h"
-#include "orchestra.h"
 #include "visualization.h"
 #include "reputation.h"
+#include "changepoint.h"
+#include "executor.h"
+#include "process.h"
+#include "tempo_tracker.h"
+#include "checkpoint.h"
+#include "deadline.h"
+#include "adversary.h"
+#include "audio.h"
+#include "midi.h"
+#include "setlist.h"
+#include "profile.h"
+#include "benchmark.h"
+#include "orchestra.h"
 
 #endif
@@ -0,0 +1,42 @@
+#include <byzantine_orchestra.h>
+
+// CUSUM change-point detection over each musician's reports, O(1) a report.
+// Each sum gathers how far reports run past what an honest musician gives
+// on average, and forgets down to zero while it plays well, so a musician
+// is flagged a few pulses after it starts misbehaving however long it played
+// honestly before. One sum is over the size of the deviations, catching
+// large ones however often they come and whichever way they go, the other
+// two over its sign, catching a steady pull in one direction that stays
+// within BPM_TOLERANCE
+
+void reset_change_detector(change_detector_t *detector) {
+    detector->magnitude = 0.0;
+    detector->faster = 0.0;
+    detector->slower = 0.0;
+}
+
+// deviation is the report over the tempo of its pulse, minus one. True once
+// any sum reaches its threshold
+bool observe_deviation(change_detector_t *detector, double deviation) {
+    double z = deviation / BPM_TOLERANCE;
+
+    if (z > CHANGE_MAX_DEVIATION) {
+        z = CHANGE_MAX_DEVIATION;
+    } else if (z < -CHANGE_MAX_DEVIATION) {
+        z = -CHANGE_MAX_DEVIATION;
+    }
+
+    detector->magnitude = fmax(0.0, detector->magnitude + fabs(z) - CHANGE_MAGNITUDE_SLACK);
+    detector->faster = fmax(0.0, detector->faster + z - CHANGE_DRIFT_SLACK);
+    detector->slower = fmax(0.0, detector->slower - z - CHANGE_DRIFT_SLACK);
+
+    return detector->magnitude >= CHANGE_MAGNITUDE_THRESHOLD ||
+           detector->faster >= CHANGE_DRIFT_THRESHOLD ||
+           detector->slower >= CHANGE_DRIFT_THRESHOLD;
+}
+
+// The sum closest to its threshold, as a share of it
+double change_statistic(const change_detector_t *detector) {
+    double drift = fmax(detector->faster, detector->slower) / CHANGE_DRIFT_THRESHOLD;
+    return fmax(detector->magnitude / CHANGE_MAGNITUDE_THRESHOLD, drift);
+}
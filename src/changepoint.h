@@ -0,0 +1,18 @@
+#ifndef CHANGEPOINT_H
+#define CHANGEPOINT_H
+
+// Deviations are measured in BPM_TOLERANCEs. An honest musician's are
+// uniform in [-1, 1], so average 0.5 in size and 0 in sign
+#define CHANGE_MAGNITUDE_SLACK 0.75
+#define CHANGE_DRIFT_SLACK 0.5
+// Sums that flag a musician, neither reachable by one report alone
+#define CHANGE_MAGNITUDE_THRESHOLD 4.0
+#define CHANGE_DRIFT_THRESHOLD 4.0
+// A single wild report counts no more than the worst byzantine one
+#define CHANGE_MAX_DEVIATION (BYZANTINE_MAX_DEVIATION / BPM_TOLERANCE)
+
+void reset_change_detector(change_detector_t *detector);
+bool observe_deviation(change_detector_t *detector, double deviation);
+double change_statistic(const change_detector_t *detector);
+
+#endif
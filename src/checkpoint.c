@@ -0,0 +1,378 @@
+#include <byzantine_orchestra.h>
+
+// The conductor fills pending at the end of a measure, and the writer thread
+// swaps it with writing so the disk never holds up a beat. A snapshot taken
+// while the previous one is still being written replaces the one pending
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    unsigned char *pending;
+    unsigned char *writing;
+    size_t bytes;
+    bool has_pending;
+    bool running;
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 4];
+} writer = { .mutex = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER };
+
+// Conductor state restored by restore_checkpoint for resume_conductor
+static bool resumed = false;
+static checkpoint_header_t resumed_header;
+static int resumed_sequence = 0;
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t length) {
+    static uint32_t table[256];
+    static bool table_ready = false;
+
+    if (!table_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static size_t checkpoint_size(const orchestra_t *orchestra) {
+    return sizeof(checkpoint_header_t) + orchestra->num_musicians * sizeof(checkpoint_musician_t) +
+           telemetry_state_size();
+}
+
+static int write_full(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// Written beside the checkpoint and renamed over it once on disk, so a crash
+// leaves either the old checkpoint or the new one, never a torn file
+static int write_checkpoint_file(const unsigned char *data, size_t length) {
+    int fd = open(writer.tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        printf("Could not create checkpoint %s: %s\n", writer.tmp_path, strerror(errno));
+        return -1;
+    }
+
+    if (write_full(fd, data, length) == -1 || fsync(fd) == -1) {
+        printf("Could not write checkpoint %s: %s\n", writer.tmp_path, strerror(errno));
+        close(fd);
+        unlink(writer.tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(writer.tmp_path, writer.path) == -1) {
+        printf("Could not replace checkpoint %s: %s\n", writer.path, strerror(errno));
+        unlink(writer.tmp_path);
+        return -1;
+    }
+
+    // The rename itself is only durable once its directory is synced
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s", writer.path);
+    int dir_fd = open(dirname(dir_path), O_RDONLY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    return 0;
+}
+
+static void* checkpoint_writer_thread(void *unused_arg) {
+    (void) unused_arg;
+
+    pthread_mutex_lock(&writer.mutex);
+
+    while (writer.running || writer.has_pending) {
+        if (!writer.has_pending) {
+            pthread_cond_wait(&writer.ready, &writer.mutex);
+            continue;
+        }
+
+        unsigned char *swap = writer.writing;
+        writer.writing = writer.pending;
+        writer.pending = swap;
+        writer.has_pending = false;
+        pthread_mutex_unlock(&writer.mutex);
+
+        uint64_t start_ns = monotonic_time_ns();
+        checkpoint_header_t *header = (checkpoint_header_t*) writer.writing;
+        header->crc = crc32_update(0, writer.writing, writer.bytes);
+        if (write_checkpoint_file(writer.writing, writer.bytes) == 0) {
+            record_checkpoint_write(monotonic_time_ns() - start_ns);
+        }
+        sample_thread_cpu(NULL);
+
+        pthread_mutex_lock(&writer.mutex);
+    }
+
+    pthread_mutex_unlock(&writer.mutex);
+    return NULL;
+}
+
+// Only a single concert is checkpointed, --concerts refuses --checkpoint
+int start_checkpoint_writer(const orchestra_t *orchestra, const char *path) {
+    snprintf(writer.path, sizeof(writer.path), "%s", path);
+    snprintf(writer.tmp_path, sizeof(writer.tmp_path), "%s.tmp", path);
+
+    writer.bytes = checkpoint_size(orchestra);
+    writer.pending = malloc(writer.bytes);
+    writer.writing = malloc(writer.bytes);
+    if (writer.pending == NULL || writer.writing == NULL) {
+        printf("Could not allocate %zu byte checkpoint buffers\n", writer.bytes);
+        free(writer.pending);
+        free(writer.writing);
+        writer.pending = writer.writing = NULL;
+        return -1;
+    }
+
+    writer.running = true;
+    if (start_thread(&writer.thread, NULL, checkpoint_writer_thread, NULL) != 0) {
+        perror("Could not create checkpoint writer");
+        writer.running = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Snapshot the trust state for the writer, called by the conductor between beats
+void take_checkpoint(orchestra_t *orchestra, int next_sequence, int change_sequence) {
+    if (!writer.running) return;
+
+    int num_musicians = orchestra->num_musicians;
+    uint64_t start_ns = monotonic_time_ns();
+    pthread_mutex_lock(&writer.mutex);
+
+    unsigned char *buffer = writer.pending;
+    checkpoint_header_t *header = (checkpoint_header_t*) buffer;
+    checkpoint_musician_t *entries = (checkpoint_musician_t*)(buffer + sizeof(*header));
+
+    *header = (checkpoint_header_t) {
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+        .musician_count = num_musicians,
+        .byzantine_count = orchestra->byzantine_count,
+        .telemetry_bytes = telemetry_state_size(),
+        .next_sequence = next_sequence,
+        .change_sequence = change_sequence,
+        .window_change = orchestra->tempo_window.change,
+        .window_settled_from = orchestra->tempo_window.settled_from,
+        .conductor_bpm = orchestra->conductor_bpm,
+        .target_bpm = orchestra->target_bpm,
+        .drift_estimate = orchestra->tempo_tracker.drift_estimate,
+        .drift_variance = orchestra->tempo_tracker.drift_variance
+    };
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+    uint64_t now = monotonic_time_ns();
+    for (int i = 0; i < num_musicians; i++) {
+        const standing_t *standing = &orchestra->standings[i];
+
+        entries[i] = (checkpoint_musician_t) {
+            .reputation = standing->reputation,
+            .reputation_age_ns = now > standing->reputation_time_ns ?
+                                 now - standing->reputation_time_ns : 0,
+            .blacklist_time = standing->blacklist_time,
+            .probation_since = standing->probation_since,
+            .probation_good_pulses = standing->probation_good_pulses,
+            .reinstated_from = standing->reinstated_from,
+            .reinstatements = standing->reinstatements,
+            .detector = standing->detector,
+            .note_index = orchestra->performances[i].note_index,
+            .is_byzantine = orchestra->musicians[i].is_byzantine,
+            .is_blacklisted = standing->is_blacklisted,
+            .detector_alarmed = standing->detector_alarmed
+        };
+    }
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+
+    save_telemetry_state(entries + num_musicians);
+
+    writer.has_pending = true;
+    pthread_cond_signal(&writer.ready);
+    pthread_mutex_unlock(&writer.mutex);
+
+    record_checkpoint_snapshot(monotonic_time_ns() - start_ns);
+}
+
+// Writes out any checkpoint still pending before returning
+void stop_checkpoint_writer() {
+    if (!writer.running) return;
+
+    pthread_mutex_lock(&writer.mutex);
+    writer.running = false;
+    pthread_cond_signal(&writer.ready);
+    pthread_mutex_unlock(&writer.mutex);
+
+    // A writer stuck on the disk keeps its buffers, the last complete
+    // checkpoint is still in place
+    if (join_thread(writer.thread, "Checkpoint writer") != 0) {
+        return;
+    }
+
+    free(writer.pending);
+    free(writer.writing);
+    writer.pending = writer.writing = NULL;
+}
+
+static int read_checkpoint_file(const orchestra_t *orchestra, const char *path,
+                                unsigned char *buffer, size_t length) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Could not open checkpoint %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t) info.st_size != length) {
+        printf("Checkpoint %s is not from an orchestra of %d musicians\n",
+               path, orchestra->num_musicians);
+        close(fd);
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t got = read(fd, buffer + done, length - done);
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) {
+            printf("Could not read checkpoint %s: %s\n", path, got == 0 ? "truncated" : strerror(errno));
+            close(fd);
+            return -1;
+        }
+        done += got;
+    }
+
+    close(fd);
+    return 0;
+}
+
+// Replaces the fresh trust state with a checkpointed one, before any
+// musician starts playing
+int restore_checkpoint(orchestra_t *orchestra, const char *path) {
+    int num_musicians = orchestra->num_musicians;
+    uint64_t start_ns = monotonic_time_ns();
+    size_t length = checkpoint_size(orchestra);
+    unsigned char *buffer = malloc(length);
+
+    if (buffer == NULL) {
+        printf("Could not allocate %zu bytes to restore checkpoint\n", length);
+        return -1;
+    }
+
+    if (read_checkpoint_file(orchestra, path, buffer, length) != 0) {
+        free(buffer);
+        return -1;
+    }
+
+    checkpoint_header_t *header = (checkpoint_header_t*) buffer;
+    const checkpoint_musician_t *entries = (const checkpoint_musician_t*)(buffer + sizeof(*header));
+    uint32_t crc = header->crc;
+    header->crc = 0;
+
+    if (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION) {
+        printf("%s is not a version %d checkpoint\n", path, CHECKPOINT_VERSION);
+        free(buffer);
+        return -1;
+    }
+    if (crc32_update(0, buffer, length) != crc) {
+        printf("Checkpoint %s is corrupt\n", path);
+        free(buffer);
+        return -1;
+    }
+    if (header->musician_count != (uint32_t) num_musicians ||
+        header->telemetry_bytes != telemetry_state_size()) {
+        printf("Checkpoint %s is not from an orchestra of %d musicians\n", path, num_musicians);
+        free(buffer);
+        return -1;
+    }
+
+    // A finished piece is played again from the top with the trust it ended with
+    resumed_sequence = header->next_sequence < MAX_PULSES ? header->next_sequence : 0;
+    bool rewound = resumed_sequence != header->next_sequence;
+
+    initialize_reputation_system(orchestra);
+
+    uint64_t now = monotonic_time_ns();
+    int blacklisted = 0;
+    orchestra->byzantine_count = header->byzantine_count;
+    for (int i = 0; i < num_musicians; i++) {
+        const checkpoint_musician_t *entry = &entries[i];
+        standing_t *standing = &orchestra->standings[i];
+
+        orchestra->musicians[i].is_byzantine = entry->is_byzantine;
+        orchestra->performances[i].note_index = entry->note_index;
+        standing->reputation = entry->reputation;
+        standing->reputation_time_ns = now > entry->reputation_age_ns ?
+                                       now - entry->reputation_age_ns : 0;
+        standing->is_blacklisted = entry->is_blacklisted;
+        standing->blacklist_time = entry->blacklist_time;
+        standing->probation_since = entry->probation_since;
+        standing->probation_good_pulses = entry->probation_good_pulses;
+        standing->reinstated_from = entry->reinstated_from;
+        standing->reinstatements = entry->reinstatements;
+        standing->detector = entry->detector;
+        standing->detector_alarmed = entry->detector_alarmed;
+        // Caught before this run started
+        standing->detected_at = standing->is_blacklisted ? 0 : -1;
+        blacklisted += standing->is_blacklisted;
+
+        // Pulse numbers start again with the piece
+        if (rewound) {
+            standing->probation_since = standing->probation_since >= 0 ? 0 : -1;
+            standing->reinstated_from = 0;
+        }
+    }
+
+    restore_telemetry_state(entries + num_musicians);
+
+    orchestra->conductor_bpm = header->conductor_bpm;
+    orchestra->target_bpm = header->target_bpm;
+    resumed_header = *header;
+    if (rewound) {
+        resumed_header.change_sequence = 0;
+        resumed_header.window_change = -1;
+        resumed_header.window_settled_from = -1;
+    }
+    resumed = true;
+    free(buffer);
+
+    printf("Resumed from %s at pulse %d in %.2f ms, %d of %d musicians blacklisted\n",
+           path, resumed_sequence + 1, (monotonic_time_ns() - start_ns) / 1e6,
+           blacklisted, num_musicians);
+    return 0;
+}
+
+// Conductor state to continue from, returns the first pulse to send
+int resume_conductor(orchestra_t *orchestra, int *change_sequence) {
+    if (!resumed) return 0;
+
+    orchestra->conductor_bpm = resumed_header.conductor_bpm;
+    orchestra->target_bpm = resumed_header.target_bpm;
+    orchestra->tempo_tracker.drift_estimate = resumed_header.drift_estimate;
+    orchestra->tempo_tracker.drift_variance = resumed_header.drift_variance;
+    orchestra->tempo_window.change = resumed_header.window_change;
+    orchestra->tempo_window.settled_from = resumed_header.window_settled_from;
+    *change_sequence = resumed_header.change_sequence;
+
+    return resumed_sequence;
+}
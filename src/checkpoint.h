@@ -0,0 +1,50 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#define CHECKPOINT_MAGIC 0x4B434F42 // "BOCK"
+#define CHECKPOINT_VERSION 3
+// Beats closed between checkpoints, one measure
+#define CHECKPOINT_INTERVAL 4
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t crc; // CRC-32 of the whole file with this field zeroed
+    uint32_t musician_count;
+    uint32_t byzantine_count;
+    uint32_t telemetry_bytes;
+    int32_t next_sequence; // Oldest beat still open when the checkpoint was taken
+    int32_t change_sequence; // Pulse of the last tempo change
+    int32_t window_change; // Tempo change still settling, or -1
+    int32_t window_settled_from;
+    double conductor_bpm;
+    double target_bpm;
+    double drift_estimate;
+    double drift_variance;
+} checkpoint_header_t;
+
+// One per musician after the header, followed by the telemetry
+typedef struct {
+    double reputation;
+    uint64_t reputation_age_ns; // Decay still to apply to it
+    int64_t blacklist_time;
+    int32_t probation_since;
+    int32_t probation_good_pulses;
+    int32_t reinstated_from;
+    int32_t reinstatements;
+    change_detector_t detector;
+    uint16_t note_index;
+    uint8_t is_byzantine;
+    uint8_t is_blacklisted;
+    uint8_t detector_alarmed;
+    uint8_t reserved[3];
+} checkpoint_musician_t;
+
+int restore_checkpoint(orchestra_t *orchestra, const char *path);
+int resume_conductor(orchestra_t *orchestra, int *change_sequence);
+int start_checkpoint_writer(const orchestra_t *orchestra, const char *path);
+void take_checkpoint(orchestra_t *orchestra, int next_sequence, int change_sequence);
+void stop_checkpoint_writer();
+
+#endif
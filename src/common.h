@@ -9,15 +9,45 @@
 #include <sched.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sys/neutrino.h>
+#include <sys/syspage.h>
 #include <time.h>
 #include <sys/time.h>
 #include <ctype.h>
 #include <termios.h>
 #include <math.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <semaphore.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/resource.h>
 
 #define MIN_MUSICIANS 4
 #define MAX_MUSICIANS 7
+// Executor mode runs musicians as state machines on a worker pool
+#define MAX_ORCHESTRA_SIZE 10000
+// Concerts played at once by one process, see --concerts
+#define MAX_CONCERTS 64
+#define MAX_WORKERS 64
+#define MAX_PROCESSES 64
+#define WHEEL_TICK_NS 1000000ULL
+#define PULSE_CODE_REPORT_DEADLINE (_PULSE_CODE_MINAVAIL + 1)
+#define PULSE_CODE_BEAT (_PULSE_CODE_MINAVAIL + 2)
+#define PULSE_CODE_STOP (_PULSE_CODE_MINAVAIL + 3)
+// From a musician thread, carrying sequence * MAX_MUSICIANS + its id
+#define PULSE_CODE_DROPPED (_PULSE_CODE_MINAVAIL + 4)
+// How long shutdown waits for each thread it has told to stop
+#define SHUTDOWN_JOIN_TIMEOUT_NS 100000000ULL
+// Pulses in flight before the conductor waits, and beats kept to match late reports
+#define MAX_PIPELINE_DEPTH 4
+#define CACHE_LINE_SIZE 64
+#define BEAT_HISTORY 16
 #define DEFAULT_BPM 60
 #define MIN_BPM 40
 #define MAX_BPM 100
@@ -32,7 +62,7 @@
 #define BYZANTINE_BEHAVIOR_CHANCE 0.5
 #define DISPLAY_WIDTH 175
 #define DISPLAY_HEIGHT 45
-#define MAX_HISTORY 500
+#define VIZ_WINDOW_SECONDS 20
 #define REFRESH_INTERVAL_MS 50
 // Reputation system constants
 #define INITIAL_REPUTATION 100.0
@@ -41,10 +71,17 @@
 #define BLACKLIST_THRESHOLD 20.0
 #define FIRST_CHAIR_THRESHOLD 10.0
 #define REPUTATION_DECAY_RATE 0.95
+#define REPUTATION_DECAY_PERIOD_NS 4000000000ULL // One measure at DEFAULT_BPM
 #define GOOD_BEHAVIOR_REWARD 1.0
 #define BAD_BEHAVIOR_PENALTY 15.0
 #define EXTREME_BEHAVIOR_PENALTY 25.0
 #define CONSENSUS_THRESHOLD 0.7
+// Votes buffered per musician. Only byzantine musicians vote, once a pulse,
+// so this holds several pulses of votes for beats in flight or deferred
+#define VOTE_BUFFER_PER_MUSICIAN MAX_PIPELINE_DEPTH
+// Good pulses in a row on probation before a blacklisted musician is reinstated
+#define DEFAULT_PROBATION_STREAK 8
+#define REINSTATED_REPUTATION 50.0
 
 typedef enum {
     DEVIATION_NORMAL,
@@ -52,31 +89,94 @@ typedef enum {
     DEVIATION_FIRST_CHAIR
 } deviation_type_t;
 
-typedef struct {
-    int type; // 1 = pulse, 2 = report, 3 = reputation_vote
-    int musician_id;
-    double reported_bpm;
-    double reputation_score;
-    int target_musician_id;
-    bool is_vote_negative;
-} pulse_msg_t;
+// How the conductor sets its tempo between tempo changes
+typedef enum {
+    TEMPO_TRACKER_KALMAN,
+    TEMPO_TRACKER_AVERAGE
+} tempo_tracker_mode_t;
+
+// What blacklists a musician besides its reputation, see --detector
+typedef enum {
+    DETECTOR_CUSUM,
+    DETECTOR_REPUTATION // Reputation alone
+} detector_mode_t;
+
+// How a concert's byzantine musicians misbehave, see adversary.c
+typedef enum {
+    ADVERSARY_NONE, // Play honestly, the baseline for the others
+    ADVERSARY_RANDOM,
+    ADVERSARY_COLLUDE,
+    ADVERSARY_DRIFT,
+    ADVERSARY_ON_OFF,
+    ADVERSARY_FALSE_VOTES,
+    ADVERSARY_FLOOD,
+    ADVERSARY_COUNT // Also --adversary all, each concert playing the next in turn
+} adversary_strategy_t;
 
+// Defined in orchestra.h, once every module's types are known
+typedef struct orchestra orchestra_t;
+
+// A musician's state is split by which thread writes it, so a write on
+// every pulse never shares a cache line with another writer's
+
+// Descriptor, written only while the orchestra is set up
 typedef struct {
     int id;
+    orchestra_t *orchestra;
     pthread_t thread;
-    double perceived_bpm;
     int chid;
     int coid_to_conductor;
-    const char **notes;
-    int note_index;
     const char *name;
     bool is_byzantine;
     bool is_first_chair;
+    int partner_id; // Byzantine musician it colludes with, or -1
+} musician_t;
+
+// CPU time and context switches, see profile.c
+typedef struct {
+    uint64_t cpu_ns;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+} cpu_usage_t;
+
+// Written on every pulse by the musician's own thread or executor worker,
+// a cache line each
+typedef struct {
+    double perceived_bpm;
+    // Its part of the current piece, switched by its own thread or worker
+    const char **notes;
+    int note_count;
+    int note_index;
+    uint32_t tempo_epoch; // Of the last pulse played
+    int piece; // Of the setlist its notes come from
+    cpu_usage_t cpu; // Used playing it
+} __attribute__((aligned(CACHE_LINE_SIZE))) performance_t;
+
+// Running sums over a musician's reports, see changepoint.c
+typedef struct {
+    double magnitude;
+    double faster;
+    double slower;
+} change_detector_t;
+
+// Conductor side state, never written by the musicians' threads or workers,
+// so packed rather than padded
+typedef struct {
     bool is_blacklisted;
-    double reputation;
+    double reputation; // As of reputation_time_ns, read through musician_reputation()
+    uint64_t reputation_time_ns;
     double last_reported_bpm;
     time_t blacklist_time;
-} musician_t;
+    int probation_since; // First pulse received on probation, or -1
+    int probation_good_pulses;
+    int reinstated_from; // First pulse counted again after reinstatement
+    int reinstatements;
+    int last_report_sequence; // Latest pulse reported, or -1
+    uint32_t reported_pulses; // Bit i set once last_report_sequence - i was reported
+    int detected_at; // Pulses sent when first blacklisted, or -1
+    change_detector_t detector; // Since it was last reinstated
+    bool detector_alarmed; // First blacklisted by the detector rather than its reputation
+} standing_t;
 
 typedef struct {
     int voter_id;
@@ -85,16 +185,29 @@ typedef struct {
     double timestamp;
 } reputation_vote_t;
 
-extern musician_t musicians[MAX_MUSICIANS];
-extern int num_musicians;
-extern double conductor_bpm;
-extern double target_bpm;
-extern int conductor_chid;
-extern int coids_to_musicians[MAX_MUSICIANS];
+extern int orchestra_size;
+extern int concert_count;
 extern volatile bool program_running;
+extern bool executor_mode;
+extern int executor_workers;
+extern bool process_mode;
+extern int process_count;
+extern int pipeline_depth;
+extern tempo_tracker_mode_t tempo_tracker_mode;
+extern detector_mode_t detector_mode;
+extern adversary_strategy_t adversary_strategy;
+extern bool adversary_benchmark;
+extern bool scoring_benchmark;
+extern int probation_streak;
+extern bool quorum_mode;
+extern int quorum_size;
+extern bool degrade_mode;
+extern const char *checkpoint_file;
+extern const char *resume_file;
+extern const char *audio_sink;
+extern const char *score_file;
+extern const char *setlist_file;
 extern volatile bool viz_running;
 extern const char *musician_names[MAX_MUSICIANS];
-extern int byzantine_count;
-extern pthread_mutex_t reputation_mutex;
 
 #endif
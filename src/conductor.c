@@ -1,114 +1,616 @@
 #include <byzantine_orchestra.h>
 
-void* conductor_thread(void *unused_arg) {
-    (void) unused_arg;
-
-    double current_bpm = DEFAULT_BPM;
-    conductor_bpm = current_bpm;
-    target_bpm = current_bpm;
-
-    for (int pulse_count = 0; pulse_count < MAX_PULSES && program_running; pulse_count++) {
-        printf("\n--- Pulse %d ---\n", pulse_count + 1);
-
-        bool bpm_changed = false;
-
-        // Possibly change BPM if pulse count is start of new quarter measure
-        if ((pulse_count) % 4 == 0) {
-            if (rand() % 100 < 50) {
-            	// Random BPM between MIN_BPM and MAX_BPM
-                double new_bpm = MIN_BPM + ((double) rand() / RAND_MAX) * (MAX_BPM - MIN_BPM);
-                target_bpm = new_bpm;
-                conductor_bpm = new_bpm;
-                bpm_changed = true;
+// Musician reports, votes and timer pulses arrive on the same channel
+typedef union {
+    struct _pulse pulse;
+    msg_header_t header;
+    report_msg_t report;
+    vote_msg_t vote;
+    report_batch_msg_t report_batch;
+    vote_batch_msg_t vote_batch;
+} conductor_msg_t;
+
+// A pulse that has been sent, matched to its reports by sequence number
+typedef struct {
+    int sequence;
+    double expected_bpm;
+    double target_bpm;
+    int change_sequence; // Pulse of the tempo change this beat belongs to, or -1
+    bool bpm_changed;
+    int active_musicians;
+    int reporting_musicians;
+    int agreeing_reports; // Trusted and within BPM_TOLERANCE of expected_bpm
+    int quorum; // Agreeing reports that close the beat early, 0 waits for all
+    int late_reports;
+    double total_reported_bpm;
+    // Trusted on-time reports as a ratio of expected_bpm, for the tempo tracker
+    int trusted_reports;
+    double trusted_ratio_sum;
+    double trusted_ratio_squares;
+    uint64_t sent_time_ns;
+    bool timed_out;
+    bool closed;
+    timer_entry_t deadline;
+    beat_deadline_t budget; // Conductor work for the beat, checked as it closes
+} beat_t;
+
+// Reports received in one message, scored together once it is handled
+typedef struct {
+    int musician_ids[REPORT_BATCH_MAX];
+    double reported_bpm[REPORT_BATCH_MAX];
+    double expected_bpm[REPORT_BATCH_MAX];
+    double scores[REPORT_BATCH_MAX];
+    double deviations[REPORT_BATCH_MAX];
+    int count;
+} pending_scores_t;
+
+// Everything a concert's conductor keeps between beats
+struct conductor_state {
+    beat_t beats[BEAT_HISTORY];
+    int last_change_sequence;
+    pending_scores_t pending_scores;
+};
+
+int initialize_conductor(orchestra_t *orchestra) {
+    struct conductor_state *state = calloc(1, sizeof(*state));
+    if (state == NULL) {
+        perror("Could not allocate conductor");
+        return -1;
+    }
+
+    for (int i = 0; i < BEAT_HISTORY; i++) {
+        state->beats[i].sequence = -1;
+    }
+    state->last_change_sequence = -1;
+    orchestra->conductor = state;
+    return 0;
+}
+
+// Called once the conductor thread has returned and the timing wheel stopped
+void release_conductor(orchestra_t *orchestra) {
+    free(orchestra->conductor);
+    orchestra->conductor = NULL;
+}
+
+static beat_t* find_beat(orchestra_t *orchestra, int sequence) {
+    if (sequence < 0) return NULL;
+
+    beat_t *beat = &orchestra->conductor->beats[sequence % BEAT_HISTORY];
+    return beat->sequence == sequence ? beat : NULL;
+}
+
+static uint64_t beat_period_ns(double bpm) {
+    return (uint64_t)(MICROSECONDS_PER_MINUTE / bpm * 1000.0);
+}
+
+// Agreeing reports needed to close a beat early, 2f+1 of the active
+// musicians tolerates f byzantine ones
+static int beat_quorum(int active_musicians) {
+    int quorum = quorum_size;
+
+    if (quorum <= 0) {
+        int max_faulty = (active_musicians - 1) / 3;
+        quorum = 2 * max_faulty + 1;
+    }
+    return quorum < active_musicians ? quorum : active_musicians;
+}
+
+// Start a new beat, returns the number of musicians that received the pulse
+static int send_pulse(orchestra_t *orchestra, int sequence) {
+    struct conductor_state *state = orchestra->conductor;
+    beat_t *beat = &state->beats[sequence % BEAT_HISTORY];
+
+    if (orchestra->verbose) {
+        printf("\n--- Pulse %d ---\n", sequence + 1);
+    }
+
+    // Reuse of the slot means its old beat can no longer take reports
+    cancel_timer(&beat->deadline);
+    beat->sequence = sequence;
+    beat->bpm_changed = false;
+    beat->reporting_musicians = 0;
+    beat->agreeing_reports = 0;
+    beat->late_reports = 0;
+    beat->total_reported_bpm = 0;
+    beat->trusted_reports = 0;
+    beat->trusted_ratio_sum = 0;
+    beat->trusted_ratio_squares = 0;
+    beat->timed_out = false;
+    beat->closed = false;
+
+    // Possibly change BPM if pulse count is start of new quarter measure
+    if (sequence % 4 == 0) {
+        if (rand() % 100 < 50) {
+            // Random BPM between MIN_BPM and MAX_BPM
+            double new_bpm = MIN_BPM + ((double) rand() / RAND_MAX) * (MAX_BPM - MIN_BPM);
+            orchestra->target_bpm = new_bpm;
+            // The tracker already knows how the orchestra drifts from what it is sent
+            set_concert_tempo(orchestra, tempo_tracker_mode == TEMPO_TRACKER_KALMAN ?
+                tempo_tracker_command(&orchestra->tempo_tracker, new_bpm) : new_bpm);
+            beat->bpm_changed = true;
+            state->last_change_sequence = sequence;
+            if (orchestra->verbose) {
                 printf("Conductor: Changing tempo to %.1f BPM\n", new_bpm);
             }
         }
+    }
 
-        // Send pulse to all non-blacklisted musicians
-        pulse_msg_t msg = { .type = 1 }; // Pulse
-        int active_musicians = 0;
-
-        for (int i = 0; i < num_musicians; i++) {
-            if (!musicians[i].is_blacklisted) {
-                if (MsgSend(coids_to_musicians[i], &msg, sizeof(msg), NULL, 0) == -1) {
-                    printf("Conductor: Failed to send message to %s: %s\n",
-                           musicians[i].name, strerror(errno));
-                } else {
-                    active_musicians++;
-                }
+    beat->expected_bpm = orchestra->conductor_bpm;
+    beat->target_bpm = orchestra->target_bpm;
+    beat->change_sequence = state->last_change_sequence;
+    beat->sent_time_ns = monotonic_time_ns();
+    orchestra->beat_onsets_ns[sequence % BEAT_HISTORY] =
+        beat->sent_time_ns + beat_period_ns(orchestra->conductor_bpm);
+    start_beat_deadline(&beat->budget, orchestra, NULL, sequence,
+                        beat->sent_time_ns, beat_period_ns(orchestra->conductor_bpm));
+
+    // Every pulse carries the tempo it was sent at, so a musician plays the
+    // tempo of the pulse it answers even once the conductor has moved on
+    tempo_t tempo = orchestra->tempo.tempo;
+    tempo.sequence = sequence;
+    // Thread musicians only get the sequence in their QNX pulse, and look it up here
+    write_tempo(&orchestra->pulse_tempos[sequence % BEAT_HISTORY], &tempo);
+
+    // Send pulse to all non-blacklisted musicians
+    pulse_msg_t msg = {
+        .conductor_bpm = tempo.bpm,
+        .tempo_epoch = tempo.epoch,
+        .tempo_set_ns = tempo.set_ns
+    };
+    init_msg_header(&msg.header, MSG_PULSE, PROTOCOL_CONDUCTOR_ID, sequence);
+    int active_musicians = 0;
+
+    if (process_mode) {
+        active_musicians = process_post_pulse(orchestra, &msg);
+    }
+
+    for (int i = 0; i < orchestra->num_musicians && !process_mode; i++) {
+        bool probation = is_on_probation(orchestra, i);
+        if (orchestra->standings[i].is_blacklisted && !probation) continue;
+
+        int sent;
+        if (executor_mode) {
+            sent = executor_post_pulse(orchestra, i, &tempo);
+        } else {
+            // A QNX pulse never blocks, so a musician that is itself blocked
+            // sending a report cannot deadlock the conductor
+            sent = MsgSendPulse(orchestra->coids_to_musicians[i], -1, PULSE_CODE_BEAT, sequence);
+            if (sent == -1) {
+                printf("Conductor: Failed to send pulse to %s: %s\n",
+                       orchestra->musicians[i].name, strerror(errno));
+            } else {
+                record_wire_message(sizeof(struct _pulse), 1);
             }
         }
 
-        if (active_musicians == 0) {
-            printf("Conductor: No active musicians remaining, ending concert\n");
-            break;
+        // The beat does not wait for musicians on probation
+        if (sent == 0 && probation) {
+            mark_probation_pulse(orchestra, i, sequence);
+        } else if (sent == 0) {
+            active_musicians++;
         }
+    }
+    orchestra->pulses_sent = sequence + 1;
 
-        // Collect reports from active musicians
-        double total_reported_bpm = 0;
-        int reporting_musicians = 0;
-        time_t start_report_time = time(NULL);
+    beat->active_musicians = active_musicians;
+    beat->quorum = quorum_mode ? beat_quorum(active_musicians) : 0;
+    count_event(COUNTER_PULSES_SENT);
 
-        // Wait until all active musician reports received
-        while (reporting_musicians < active_musicians &&
-               time(NULL) - start_report_time < REPORT_TIMEOUT_SECONDS) {
-            pulse_msg_t report;
-            int rcvid = MsgReceive(conductor_chid, &report, sizeof(report), NULL);
+    // The timing wheel pulses the conductor if reports are still missing at the deadline
+    beat->deadline.kind = TIMER_REPORT_DEADLINE;
+    beat->deadline.id = sequence;
+    beat->deadline.coid = orchestra->coid_to_conductor;
+    schedule_timer(&beat->deadline,
+                   beat->sent_time_ns + REPORT_TIMEOUT_SECONDS * 1000000000ULL);
 
-            if (rcvid == -1 && errno != EINTR) {
-                printf("Conductor: Receive error: %s\n", strerror(errno));
-                break;
+    return active_musicians;
+}
+
+static void flush_pending_scores(orchestra_t *orchestra) {
+    pending_scores_t *pending = &orchestra->conductor->pending_scores;
+    if (pending->count == 0) return;
+
+    score_behaviours(pending->reported_bpm, pending->expected_bpm,
+                     pending->scores, pending->deviations, pending->count);
+    apply_behaviour_scores(orchestra, pending->musician_ids, pending->scores,
+                           pending->deviations, 0.5, pending->count);
+    pending->count = 0;
+}
+
+static void queue_score(orchestra_t *orchestra, int musician_id,
+                        double reported_bpm, double expected_bpm) {
+    pending_scores_t *pending = &orchestra->conductor->pending_scores;
+
+    if (pending->count == REPORT_BATCH_MAX) {
+        flush_pending_scores(orchestra);
+    }
+
+    int i = pending->count++;
+    pending->musician_ids[i] = musician_id;
+    pending->reported_bpm[i] = reported_bpm;
+    pending->expected_bpm[i] = expected_bpm;
+}
+
+// True the first time a musician reports a pulse. Only pulses still in the
+// beat history are asked about, so a window of 32 is enough
+static bool first_report(standing_t *standing, int sequence) {
+    int offset = standing->last_report_sequence - sequence;
+
+    if (offset < 0) {
+        standing->reported_pulses = -offset < 32 ? standing->reported_pulses << -offset : 0;
+        standing->reported_pulses |= 1;
+        standing->last_report_sequence = sequence;
+        return true;
+    }
+
+    uint32_t bit = offset < 32 ? 1u << offset : 0;
+    if (bit == 0 || (standing->reported_pulses & bit)) {
+        return false;
+    }
+    standing->reported_pulses |= bit;
+    return true;
+}
+
+static void handle_report(orchestra_t *orchestra, int sequence, int musician_id,
+                          double reported_bpm) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return;
+
+    beat_t *beat = find_beat(orchestra, sequence);
+
+    if (beat == NULL) {
+        // Its beat has left the history window
+        count_event(COUNTER_REPORTS_STALE);
+        return;
+    }
+
+    standing_t *standing = &orchestra->standings[musician_id];
+
+    // Copies would count twice towards the beat and its quorum
+    if (!first_report(standing, sequence)) {
+        count_event(COUNTER_REPORTS_DUPLICATE);
+        return;
+    }
+
+    // Consider reports from non-blacklisted musicians, one blacklisted
+    // since the pulse was sent is no longer waited for
+    if (standing->is_blacklisted) {
+        if (standing->probation_since >= 0 && sequence >= standing->probation_since) {
+            // Scored in shadow, never reaching the tempo or the vote
+            double behaviour_score = calculate_behaviour_score(reported_bpm, beat->expected_bpm);
+            shadow_score_musician(orchestra, musician_id, behaviour_score,
+                                  orchestra->pulses_sent);
+        } else if (!beat->closed) {
+            beat->active_musicians--;
+        }
+        return;
+    }
+
+    // A probation pulse answered after reinstatement was never waited for
+    if (sequence < standing->reinstated_from) {
+        return;
+    }
+
+    if (beat->closed) {
+        beat->late_reports++;
+        count_event(COUNTER_REPORTS_LATE);
+    } else {
+        beat->total_reported_bpm += reported_bpm;
+        beat->reporting_musicians++;
+        standing->last_reported_bpm = reported_bpm;
+        count_event(COUNTER_REPORTS_ON_TIME);
+
+        if (is_musician_trusted(orchestra, musician_id)) {
+            double ratio = reported_bpm / beat->expected_bpm;
+            beat->trusted_reports++;
+            beat->trusted_ratio_sum += ratio;
+            beat->trusted_ratio_squares += ratio * ratio;
+            if (fabs(ratio - 1.0) <= BPM_TOLERANCE) {
+                beat->agreeing_reports++;
             }
+        }
+    }
 
-            if (report.type == 2) { // Report
-                // Consider reports from non-blacklisted musicians
-                if (!musicians[report.musician_id].is_blacklisted) {
-                    total_reported_bpm += report.reported_bpm;
-                    reporting_musicians++;
+    // Score timing accuracy against the tempo of the beat being answered
+    queue_score(orchestra, musician_id, reported_bpm, beat->expected_bpm);
+}
 
-                    // Update reputation based on timing accuracy
-                    double behaviour_score = calculate_behaviour_score(report.reported_bpm, conductor_bpm);
-                    update_reputation(report.musician_id, behaviour_score * 0.5);
-                }
+// A musician thread already playing MAX_PIPELINE_DEPTH pulses drops the next
+// one, as does a musician process whose slot for it is still busy, and
+// never reports it
+static void handle_dropped_pulse(orchestra_t *orchestra, int sequence, int musician_id) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return;
+
+    beat_t *beat = find_beat(orchestra, sequence);
+    const standing_t *standing = &orchestra->standings[musician_id];
+    count_event(COUNTER_PULSES_DROPPED);
+
+    // A pulse sent on probation was never waited for, whether or not the
+    // musician has been reinstated since, as in handle_report()
+    bool probation = (standing->is_blacklisted && standing->probation_since >= 0 &&
+                      sequence >= standing->probation_since) ||
+                     (!standing->is_blacklisted && sequence < standing->reinstated_from);
+    if (beat != NULL && !beat->closed && !probation) {
+        beat->active_musicians--;
+    }
+}
+
+static bool beat_complete(const beat_t *beat) {
+    return beat->reporting_musicians >= beat->active_musicians || beat->timed_out ||
+           (beat->quorum > 0 && beat->agreeing_reports >= beat->quorum);
+}
+
+static void close_beat(orchestra_t *orchestra, beat_t *beat) {
+    uint64_t close_start_ns = monotonic_time_ns();
+    beat->closed = true;
+    cancel_timer(&beat->deadline);
+    uint64_t nominal_onset_ns = beat->sent_time_ns + beat_period_ns(beat->expected_bpm);
+    record_beat_latency((int64_t)(close_start_ns - nominal_onset_ns));
+
+    // Reports still to come are scored as late, but no longer held up the beat
+    if (beat->reporting_musicians < beat->active_musicians && !beat->timed_out) {
+        count_event(COUNTER_QUORUM_CLOSES);
+        if (orchestra->verbose && !is_large_orchestra(orchestra)) {
+            printf("Conductor: Quorum of %d agreeing reports reached for pulse %d, %d still to come\n",
+                   beat->agreeing_reports, beat->sequence + 1,
+                   beat->active_musicians - beat->reporting_musicians);
+        }
+    }
+
+    if (beat->timed_out && orchestra->verbose) {
+        printf("Conductor: Report deadline passed for pulse %d with %d of %d reports\n",
+               beat->sequence + 1, beat->reporting_musicians, beat->active_musicians);
+    }
+
+    // Reports still coming in past the deadline are blamed for the overrun
+    check_deadline(&beat->budget, STAGE_REPORTS);
+    update_load_shedding(orchestra, &beat->budget);
+
+    // Votes wait in their buffer for a beat with time to spare
+    if (!should_shed(orchestra, SHED_VOTES)) {
+        process_reputation_votes(orchestra);
+    }
+    check_deadline(&beat->budget, STAGE_VOTES);
+
+    if (beat->trusted_reports > 0) {
+        double ratio_mean = beat->trusted_ratio_sum / beat->trusted_reports;
+        double ratio_variance = beat->trusted_ratio_squares / beat->trusted_reports -
+                                ratio_mean * ratio_mean;
+
+        record_beat_tempo(&orchestra->tempo_window, beat->sequence,
+                          beat->expected_bpm * ratio_mean, beat->target_bpm,
+                          beat->change_sequence);
+        tempo_tracker_observe(&orchestra->tempo_tracker, ratio_mean, ratio_variance,
+                              beat->trusted_reports);
+    }
+
+    if (tempo_tracker_mode == TEMPO_TRACKER_KALMAN) {
+        // Hold the target, correcting for the drift seen so far
+        set_concert_tempo(orchestra, tempo_tracker_command(&orchestra->tempo_tracker,
+                                                           orchestra->target_bpm));
+        if (orchestra->verbose) {
+            printf("Conductor: Orchestra drift %+.2f%%, conducting at %.1f BPM for %.1f BPM\n",
+                   tempo_tracker_drift(&orchestra->tempo_tracker) * 100.0,
+                   orchestra->conductor_bpm, orchestra->target_bpm);
+        }
+    } else if (!beat->bpm_changed && beat->reporting_musicians > 0) {
+        // Update conductor's BPM based on trusted musicians only
+        double trusted_bpm_sum = 0;
+        int trusted_count = 0;
+
+        for (int i = 0; i < orchestra->num_musicians; i++) {
+            if (is_musician_trusted(orchestra, i)) {
+                trusted_bpm_sum += orchestra->standings[i].last_reported_bpm;
+                trusted_count++;
             }
+        }
 
-            MsgReply(rcvid, EOK, NULL, 0);
+        if (trusted_count > 0) {
+            set_concert_tempo(orchestra, trusted_bpm_sum / trusted_count);
+            if (orchestra->verbose) {
+                printf("Conductor: Average trusted BPM: %.1f (from %d trusted musicians)\n",
+                       orchestra->conductor_bpm, trusted_count);
+            }
+        } else if (orchestra->verbose) {
+            printf("Conductor: No trusted musicians available, maintaining tempo\n");
         }
+    } else if (!beat->bpm_changed && orchestra->verbose) {
+        printf("Conductor: No reports received, keeping current tempo\n");
+    }
+
+    check_deadline(&beat->budget, STAGE_TEMPO);
+
+    // Status output is left out, its cost depends on the terminal
+    record_beat_close_time(monotonic_time_ns() - close_start_ns);
+    if (orchestra->verbose && !should_shed(orchestra, SHED_STATUS)) {
+        print_reputation_status(orchestra);
+    }
+    check_deadline(&beat->budget, STAGE_STATUS);
+    finish_beat_deadline(&beat->budget);
+}
+
+// Receive one report or timer pulse, giving up at wake_ns (0 waits indefinitely)
+static void receive_conductor_message(orchestra_t *orchestra, uint64_t wake_ns) {
+    conductor_msg_t msg;
+
+    if (wake_ns != 0) {
+        uint64_t now = monotonic_time_ns();
+        uint64_t timeout = wake_ns > now ? wake_ns - now : 0;
+        TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, NULL, &timeout, NULL);
+    }
+
+    int rcvid = MsgReceive(orchestra->conductor_chid, &msg, sizeof(msg), NULL);
 
-        process_reputation_votes();
+    if (rcvid == -1) {
+        if (errno != ETIMEDOUT && errno != EINTR) {
+            printf("Conductor: Receive error: %s\n", strerror(errno));
+        }
+        return;
+    }
 
-        // Apply reputation decay
-        if (pulse_count % 4 == 0) { // Every measure
-            decay_all_reputations();
+    if (rcvid == 0) { // Timer pulse, or a musician thread dropping one of ours
+        if (msg.pulse.code == PULSE_CODE_REPORT_DEADLINE) {
+            beat_t *beat = find_beat(orchestra, msg.pulse.value.sival_int);
+            if (beat != NULL && !beat->closed) {
+                beat->timed_out = true;
+            }
+        } else if (msg.pulse.code == PULSE_CODE_DROPPED) {
+            handle_dropped_pulse(orchestra, msg.pulse.value.sival_int / MAX_MUSICIANS,
+                                 msg.pulse.value.sival_int % MAX_MUSICIANS);
         }
+        return;
+    }
 
-        // Update conductor's BPM based on trusted musicians only
-        if (!bpm_changed && reporting_musicians > 0) {
-            double trusted_bpm_sum = 0;
-            int trusted_count = 0;
-
-            for (int i = 0; i < num_musicians; i++) {
-                if (is_musician_trusted(i)) {
-                    trusted_bpm_sum += musicians[i].last_reported_bpm;
-                    trusted_count++;
+    if (msg.header.version != PROTOCOL_VERSION) {
+        MsgError(rcvid, ENOTSUP);
+        return;
+    }
+
+    uint64_t now = monotonic_time_ns();
+    if (now > msg.header.timestamp_ns) {
+        record_report_transit(now - msg.header.timestamp_ns);
+    }
+
+    switch (msg.header.type) {
+    case MSG_REPORT:
+        handle_report(orchestra, msg.header.sequence, msg.header.sender,
+                      msg.report.reported_bpm);
+        flush_pending_scores(orchestra);
+        break;
+
+    case MSG_REPORT_BATCH:
+        for (int i = 0; i < msg.report_batch.count && i < REPORT_BATCH_MAX; i++) {
+            const report_entry_t *entry = &msg.report_batch.entries[i];
+            handle_report(orchestra, entry->sequence, entry->musician_id, entry->reported_bpm);
+        }
+        flush_pending_scores(orchestra);
+        break;
+
+    case MSG_VOTE:
+        cast_reputation_vote(orchestra, msg.header.sender, msg.vote.target_id,
+                             msg.vote.is_negative);
+        break;
+
+    case MSG_DROPPED:
+        handle_dropped_pulse(orchestra, msg.header.sequence, msg.header.sender);
+        break;
+
+    case MSG_VOTE_BATCH:
+        for (int i = 0; i < msg.vote_batch.count && i < VOTE_BATCH_MAX; i++) {
+            const vote_entry_t *entry = &msg.vote_batch.entries[i];
+            cast_reputation_vote(orchestra, entry->voter_id, entry->target_id,
+                                 entry->is_negative);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    MsgReply(rcvid, EOK, NULL, 0);
+}
+
+void* conductor_thread(void *arg) {
+    orchestra_t *orchestra = (orchestra_t*) arg;
+    struct conductor_state *state = orchestra->conductor;
+    beat_t *beats = state->beats;
+
+    profile_thread(ROLE_CONDUCTOR);
+    struct timespec cpu_start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+
+    int next_sequence = resume_conductor(orchestra, &state->last_change_sequence);
+    int oldest_open = next_sequence;
+    orchestra->pulses_sent = next_sequence;
+    uint64_t next_pulse_ns = monotonic_time_ns();
+    int last_pulse = setlist_pulses();
+
+    while (program_running && (next_sequence < last_pulse || oldest_open < next_sequence)) {
+        int in_flight = next_sequence - oldest_open;
+        bool can_send = next_sequence < last_pulse && in_flight < pipeline_depth;
+
+        // Lockstep sends as soon as the previous beat closes, pipelining keeps the tempo
+        if (can_send && (pipeline_depth == 1 || monotonic_time_ns() >= next_pulse_ns)) {
+            // The next piece of a setlist starts on a pulse boundary, staged
+            // while the one before played
+            bool new_piece = next_sequence > 0 && next_sequence % MAX_PULSES == 0;
+            if (new_piece && begin_piece(orchestra, next_sequence / MAX_PULSES) != 0) {
+                last_pulse = next_sequence;
+                continue;
+            }
+
+            uint64_t now = monotonic_time_ns();
+            if (next_sequence > 0) {
+                uint64_t drift = now > next_pulse_ns ? now - next_pulse_ns : 0;
+                record_pulse_drift(drift);
+                if (new_piece) {
+                    record_piece_switch(drift);
                 }
             }
 
-            if (trusted_count > 0) {
-                conductor_bpm = trusted_bpm_sum / trusted_count;
-                printf("Conductor: Average trusted BPM: %.1f (from %d trusted musicians)\n",
-                       conductor_bpm, trusted_count);
-            } else {
-                printf("Conductor: No trusted musicians available, maintaining tempo\n");
+            if (send_pulse(orchestra, next_sequence) == 0) {
+                if (orchestra->verbose) {
+                    printf("Conductor: No active musicians remaining, ending concert\n");
+                }
+                next_sequence++;
+                break;
+            }
+
+            next_pulse_ns = now + beat_period_ns(orchestra->conductor_bpm);
+            next_sequence++;
+            sample_thread_cpu(NULL);
+            continue;
+        }
+
+        // Nothing to send yet, wait for reports or until the next pulse is due
+        receive_conductor_message(orchestra, can_send ? next_pulse_ns : 0);
+
+        // Beats close in order once complete or past their deadline
+        while (oldest_open < next_sequence) {
+            beat_t *beat = &beats[oldest_open % BEAT_HISTORY];
+
+            if (!beat_complete(beat)) {
+                break;
+            }
+
+            close_beat(orchestra, beat);
+            oldest_open++;
+
+            if (oldest_open % CHECKPOINT_INTERVAL == 0) {
+                take_checkpoint(orchestra, oldest_open, state->last_change_sequence);
+                check_deadline(&beat->budget, STAGE_CHECKPOINT);
             }
-        } else if (!bpm_changed) {
-            printf("Conductor: No reports received, keeping current tempo\n");
         }
 
+        // The other threads shed load while the oldest open beat runs short
+        update_load_shedding(orchestra, oldest_open < next_sequence ?
+                             &beats[oldest_open % BEAT_HISTORY].budget : NULL);
+    }
+
+    leave_setlist(orchestra);
 
-        print_reputation_status();
+    // What the last beats taught is kept for the next concert too
+    take_checkpoint(orchestra, oldest_open, state->last_change_sequence);
+    finish_tempo_window(&orchestra->tempo_window);
+
+    // Beats still open when the concert stops will never close
+    for (int i = 0; i < BEAT_HISTORY; i++) {
+        cancel_timer(&beats[i].deadline);
     }
 
-    printf("\n--- Concert ended after %d pulses ---\n", MAX_PULSES);
+    struct timespec cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    adversary_finish_concert(orchestra,
+                             (uint64_t)(cpu_end.tv_sec - cpu_start.tv_sec) * 1000000000ULL +
+                             cpu_end.tv_nsec - cpu_start.tv_nsec);
+
+    // Other concerts may still be playing, so release any worker or musician
+    // blocked sending this one a report
+    orchestra->playing = false;
+    ChannelDestroy(orchestra->conductor_chid);
+    orchestra->conductor_chid = 0;
+
+    if (orchestra->verbose) {
+        printf("\n--- Concert ended after %d pulses ---\n", next_sequence);
+    }
     return NULL;
 }
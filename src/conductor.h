@@ -1,6 +1,8 @@
 #ifndef CONDUCTOR_H
 #define CONDUCTOR_H
 
+int initialize_conductor(orchestra_t *orchestra);
+void release_conductor(orchestra_t *orchestra);
 void* conductor_thread(void *arg);
 
 #endif
@@ -0,0 +1,127 @@
+#include <byzantine_orchestra.h>
+
+// A beat must be settled before the next one is heard. The next pulse is
+// due one period after this one and played a period later, so each
+// iteration has two periods from its pulse
+#define BEAT_DEADLINE_PERIODS 2
+
+static const char *stage_labels[STAGE_COUNT] = {
+    "reports", "votes", "tempo", "status", "checkpoint",
+    "onset", "play", "report"
+};
+
+static const char *shed_labels[SHED_COUNT] = {
+    "status prints", "vote rounds", "visualizer frames", "note lines"
+};
+
+// Updated from every musician thread, so counted atomically
+static uint64_t conductor_beats = 0;
+static uint64_t musician_beats = 0;
+static uint64_t stage_misses[STAGE_COUNT];
+static uint64_t shed_counts[SHED_COUNT];
+
+// Each concert sheds on its own: orchestra->overrunning is set by any missed
+// deadline and cleared when one of its beats closes within its own
+void start_beat_deadline(beat_deadline_t *deadline, orchestra_t *orchestra,
+                         const musician_t *musician, int sequence,
+                         uint64_t pulse_ns, uint64_t period_ns) {
+    __atomic_add_fetch(musician == NULL ? &conductor_beats : &musician_beats, 1, __ATOMIC_RELAXED);
+
+    deadline->orchestra = orchestra;
+    deadline->musician = musician;
+    deadline->sequence = sequence;
+    deadline->period_ns = period_ns;
+    deadline->deadline_ns = pulse_ns + BEAT_DEADLINE_PERIODS * period_ns;
+    deadline->missed = false;
+}
+
+// Called as each stage finishes, the first one to end past the deadline is
+// blamed for the overrun. Returns true once the deadline has passed
+bool check_deadline(beat_deadline_t *deadline, deadline_stage_t stage) {
+    if (deadline->missed) return true;
+
+    uint64_t now = monotonic_time_ns();
+    if (now <= deadline->deadline_ns) return false;
+
+    orchestra_t *orchestra = deadline->orchestra;
+    deadline->missed = true;
+    __atomic_add_fetch(&stage_misses[stage], 1, __ATOMIC_RELAXED);
+    orchestra->overrunning = true;
+    orchestra->shedding = degrade_mode;
+
+    // Concerts that do not print their beats only count their misses
+    if (!orchestra->verbose) return true;
+
+    if (deadline->musician == NULL) {
+        printf("Conductor: Pulse %d missed its deadline by %.1f ms in %s\n",
+               deadline->sequence + 1,
+               (now - deadline->deadline_ns) / 1e6, stage_labels[stage]);
+    } else if (!is_large_orchestra(orchestra)) {
+        // Per-musician output would swamp the terminal for large orchestras
+        printf("%s: Pulse %d missed its deadline by %.1f ms in %s\n",
+               deadline->musician->name, deadline->sequence + 1,
+               (now - deadline->deadline_ns) / 1e6, stage_labels[stage]);
+    }
+    return true;
+}
+
+static bool deadline_threatened(const beat_deadline_t *deadline) {
+    uint64_t margin_ns = (uint64_t)(deadline->period_ns * DEADLINE_MARGIN);
+    return monotonic_time_ns() + margin_ns > deadline->deadline_ns;
+}
+
+// Called by the conductor once a beat has closed, so load stays shed
+// until a beat is back within its deadline
+void finish_beat_deadline(const beat_deadline_t *deadline) {
+    deadline->orchestra->overrunning = deadline->missed;
+}
+
+// Called by the conductor with the oldest beat still open, the work the
+// other threads may shed follows it
+void update_load_shedding(orchestra_t *orchestra, const beat_deadline_t *deadline) {
+    if (!degrade_mode) return;
+
+    orchestra->shedding = orchestra->overrunning ||
+                          (deadline != NULL && deadline_threatened(deadline));
+}
+
+// True, and counted, when a concert should skip work to protect its deadlines
+bool should_shed(orchestra_t *orchestra, shed_work_t work) {
+    if (!degrade_mode || !orchestra->shedding) return false;
+
+    __atomic_add_fetch(&shed_counts[work], 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void print_stage_misses(const char *label, uint64_t beats,
+                               int first, int last) {
+    uint64_t total = 0;
+    for (int i = first; i <= last; i++) {
+        total += stage_misses[i];
+    }
+
+    printf("Deadline misses, %s: %llu of %llu pulses", label,
+           (unsigned long long) total, (unsigned long long) beats);
+    for (int i = first; i <= last && total > 0; i++) {
+        printf("%s%s %llu", i == first ? " (" : ", ", stage_labels[i],
+               (unsigned long long) stage_misses[i]);
+    }
+    printf("%s\n", total > 0 ? ")" : "");
+}
+
+void print_deadline_summary() {
+    print_stage_misses("conductor", conductor_beats, STAGE_REPORTS, STAGE_CHECKPOINT);
+    // Musician processes check their deadlines against their own counts
+    if (!process_mode) {
+        print_stage_misses("musicians", musician_beats, STAGE_ONSET, STAGE_REPORT);
+    }
+
+    if (degrade_mode) {
+        printf("Shed under threatened deadlines:");
+        for (int i = 0; i < SHED_COUNT; i++) {
+            printf("%s%llu %s", i == 0 ? " " : ", ",
+                   (unsigned long long) shed_counts[i], shed_labels[i]);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+// Less than this much of a beat period left before its deadline threatens it
+#define DEADLINE_MARGIN 0.25
+
+// Where a beat's time went when it overran its deadline
+typedef enum {
+    STAGE_REPORTS, // Conductor still waiting on the beat's reports
+    STAGE_VOTES,
+    STAGE_TEMPO,
+    STAGE_STATUS,
+    STAGE_CHECKPOINT,
+    STAGE_ONSET, // Musician woken for its note
+    STAGE_PLAY,
+    STAGE_REPORT,
+    STAGE_COUNT
+} deadline_stage_t;
+
+// Non-critical work skipped by --degrade when a deadline is threatened
+typedef enum {
+    SHED_STATUS,
+    SHED_VOTES,
+    SHED_FRAMES,
+    SHED_NOTE_LINES,
+    SHED_COUNT
+} shed_work_t;
+
+// One conductor or musician iteration, checked stage by stage
+typedef struct {
+    orchestra_t *orchestra;
+    const musician_t *musician; // NULL for the conductor
+    int sequence;
+    uint64_t period_ns;
+    uint64_t deadline_ns;
+    bool missed;
+} beat_deadline_t;
+
+void start_beat_deadline(beat_deadline_t *deadline, orchestra_t *orchestra,
+                         const musician_t *musician, int sequence,
+                         uint64_t pulse_ns, uint64_t period_ns);
+bool check_deadline(beat_deadline_t *deadline, deadline_stage_t stage);
+void finish_beat_deadline(const beat_deadline_t *deadline);
+void update_load_shedding(orchestra_t *orchestra, const beat_deadline_t *deadline);
+bool should_shed(orchestra_t *orchestra, shed_work_t work);
+void print_deadline_summary();
+
+#endif
@@ -0,0 +1,424 @@
+#include <byzantine_orchestra.h>
+
+// Each musician is a small state machine stepped by a shared worker pool,
+// with one slot per pulse it may have in flight. Every concert's musicians
+// share the same workers
+typedef enum {
+    TASK_IDLE,
+    TASK_PULSE,
+    TASK_ONSET,
+    TASK_REPORT
+} task_state_t;
+
+// A concert's tasks are orchestra->tasks[musician_id * MAX_PIPELINE_DEPTH + slot]
+struct musician_task {
+    // Read by the conductor while a worker steps the task. A worker done with
+    // the slot releases TASK_IDLE, which the conductor acquires before reuse
+    task_state_t state;
+    int sequence;
+    tempo_t tempo; // Carried by the pulse
+    double bpm;
+    uint64_t pulse_time_ns;
+    uint64_t onset_time_ns;
+    timer_entry_t onset_timer;
+    orchestra_t *orchestra;
+    int musician_id;
+    int home_worker; // Worker whose queue the task is pushed on
+    // Only used on the musician's first slot, set while a worker steps any
+    // of its slots, see claim_musician()
+    bool stepping;
+};
+typedef struct musician_task musician_task_t;
+
+#define TASK_INDEX(musician_id, slot) ((musician_id) * MAX_PIPELINE_DEPTH + (slot))
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    // Runnable tasks, owner works at the tail and thieves take from the head
+    musician_task_t **run_queue;
+    int head;
+    int tail;
+    // Reports coalesced until the worker runs out of work, the batch fills
+    // or a task of another concert comes up
+    report_batch_msg_t batch;
+    orchestra_t *batch_orchestra;
+} worker_t;
+
+static worker_t workers[MAX_WORKERS];
+static int worker_count = 0;
+static int queue_capacity = 0;
+static int attached_musicians = 0;
+static volatile bool executor_running = false;
+
+static void* worker_thread(void *arg);
+
+int executor_worker_count() {
+    return worker_count;
+}
+
+// task_capacity is the number of tasks of every concert to be attached
+int initialize_executor(int requested_workers, int task_capacity) {
+    int workers_to_start = requested_workers;
+
+    // Default to one worker per online CPU
+    if (workers_to_start <= 0) {
+        workers_to_start = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (workers_to_start < 1) {
+        workers_to_start = 1;
+    } else if (workers_to_start > MAX_WORKERS) {
+        workers_to_start = MAX_WORKERS;
+    }
+
+    // A worker may briefly hold every task when the others are idle
+    queue_capacity = task_capacity + 1;
+    attached_musicians = 0;
+    executor_running = true;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    for (int i = 0; i < workers_to_start; i++) {
+        worker_t *worker = &workers[i];
+
+        worker->id = i;
+        worker->head = 0;
+        worker->tail = 0;
+        worker->batch.count = 0;
+        worker->batch_orchestra = NULL;
+        worker->run_queue = malloc(sizeof(*worker->run_queue) * queue_capacity);
+        if (worker->run_queue == NULL) {
+            perror("Could not allocate worker queue");
+            pthread_condattr_destroy(&cond_attr);
+            return -1;
+        }
+
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->wake, &cond_attr);
+
+        if (start_thread(&worker->thread, NULL, worker_thread, worker) != 0) {
+            perror("Could not create worker thread");
+            free(worker->run_queue);
+            pthread_condattr_destroy(&cond_attr);
+            return -1;
+        }
+        worker_count++;
+    }
+
+    pthread_condattr_destroy(&cond_attr);
+
+    // Each musician process runs its own executor, the launcher reports them
+    if (!process_mode) {
+        printf("Executor running %d musicians on %d worker threads\n",
+               task_capacity / MAX_PIPELINE_DEPTH, worker_count);
+    }
+    return 0;
+}
+
+// Give a concert's musicians tasks on the pool, spread over the workers
+// after those of the concerts attached before it
+int executor_attach_orchestra(orchestra_t *orchestra) {
+    int task_count = orchestra->num_musicians * MAX_PIPELINE_DEPTH;
+    musician_task_t *tasks = calloc(task_count, sizeof(*tasks));
+
+    if (tasks == NULL) {
+        perror("Could not allocate musician tasks");
+        return -1;
+    }
+
+    for (int i = 0; i < task_count; i++) {
+        int musician_id = i / MAX_PIPELINE_DEPTH;
+
+        tasks[i].state = TASK_IDLE;
+        tasks[i].orchestra = orchestra;
+        tasks[i].musician_id = musician_id;
+        tasks[i].home_worker = (attached_musicians + musician_id) % worker_count;
+        tasks[i].onset_timer.kind = TIMER_NOTE_ONSET;
+        tasks[i].onset_timer.pending = false;
+        tasks[i].stepping = false;
+    }
+
+    attached_musicians += orchestra->num_musicians;
+    orchestra->tasks = tasks;
+    return 0;
+}
+
+// Called once the workers and the timing wheel have stopped
+void executor_detach_orchestra(orchestra_t *orchestra) {
+    free(orchestra->tasks);
+    orchestra->tasks = NULL;
+}
+
+void shutdown_executor() {
+    executor_running = false;
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_mutex_lock(&workers[i].lock);
+        pthread_cond_signal(&workers[i].wake);
+        pthread_mutex_unlock(&workers[i].lock);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        if (join_thread(workers[i].thread, "Executor worker") != 0) {
+            continue;
+        }
+        pthread_cond_destroy(&workers[i].wake);
+        pthread_mutex_destroy(&workers[i].lock);
+        free(workers[i].run_queue);
+    }
+
+    worker_count = 0;
+}
+
+// A pipelined musician has several slots in flight, which could otherwise
+// be stepped on two workers at once and race on its performance_t. A worker
+// claims the musician before stepping any of them
+static bool claim_musician(musician_task_t *task) {
+    musician_task_t *first = &task->orchestra->tasks[TASK_INDEX(task->musician_id, 0)];
+    bool stepping = false;
+
+    return __atomic_compare_exchange_n(&first->stepping, &stepping, true, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void release_musician(musician_task_t *task) {
+    musician_task_t *first = &task->orchestra->tasks[TASK_INDEX(task->musician_id, 0)];
+    __atomic_store_n(&first->stepping, false, __ATOMIC_RELEASE);
+}
+
+// Run queue helpers, called with worker->lock held
+
+static void push_task(worker_t *worker, musician_task_t *task) {
+    worker->run_queue[worker->tail] = task;
+    worker->tail = (worker->tail + 1) % queue_capacity;
+}
+
+// The task nearest one end of the queue whose musician could be claimed,
+// swapped with the one at that end and taken. At most one task per other
+// worker is passed over
+static bool take_task(worker_t *worker, bool from_head, musician_task_t **task) {
+    int count = (worker->tail - worker->head + queue_capacity) % queue_capacity;
+    int end = from_head ? worker->head : (worker->tail - 1 + queue_capacity) % queue_capacity;
+
+    for (int i = 0; i < count; i++) {
+        int at = from_head ? (worker->head + i) % queue_capacity :
+                             (worker->tail - 1 - i + queue_capacity) % queue_capacity;
+        musician_task_t *candidate = worker->run_queue[at];
+        if (!claim_musician(candidate)) continue;
+
+        worker->run_queue[at] = worker->run_queue[end];
+        if (from_head) {
+            worker->head = (worker->head + 1) % queue_capacity;
+        } else {
+            worker->tail = end;
+        }
+        *task = candidate;
+        return true;
+    }
+    return false;
+}
+
+static bool pop_task(worker_t *worker, musician_task_t **task) {
+    return take_task(worker, false, task);
+}
+
+static bool steal_from(worker_t *victim, musician_task_t **task) {
+    return take_task(victim, true, task);
+}
+
+int executor_post_pulse(orchestra_t *orchestra, int musician_id, const tempo_t *tempo) {
+    int sequence = tempo->sequence;
+    musician_task_t *task = &orchestra->tasks[TASK_INDEX(musician_id, sequence % MAX_PIPELINE_DEPTH)];
+    worker_t *worker = &workers[task->home_worker];
+
+    // Still busy with the pulse that last used this slot
+    if (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) != TASK_IDLE) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    __atomic_store_n(&task->state, TASK_PULSE, __ATOMIC_RELAXED);
+    task->sequence = sequence;
+    task->tempo = *tempo;
+    task->pulse_time_ns = monotonic_time_ns();
+    push_task(worker, task);
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+    return 0;
+}
+
+static musician_task_t* task_of_timer(timer_entry_t *entry) {
+    return (musician_task_t*)((char*) entry - offsetof(musician_task_t, onset_timer));
+}
+
+// Called by the timer thread with every onset timer that expired on a tick
+void executor_dispatch_onsets(timer_entry_t **entries, int count) {
+    for (int w = 0; w < worker_count; w++) {
+        worker_t *worker = &workers[w];
+        bool dispatched = false;
+
+        pthread_mutex_lock(&worker->lock);
+        for (int i = 0; i < count; i++) {
+            musician_task_t *task = task_of_timer(entries[i]);
+            if (task->home_worker == w) {
+                push_task(worker, task);
+                dispatched = true;
+            }
+        }
+        if (dispatched) {
+            pthread_cond_signal(&worker->wake);
+        }
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+static bool next_task(worker_t *worker, musician_task_t **task) {
+    pthread_mutex_lock(&worker->lock);
+    bool found = pop_task(worker, task);
+    pthread_mutex_unlock(&worker->lock);
+
+    if (found) return true;
+
+    // Own queue is empty, try to steal from the other workers
+    for (int i = 1; i < worker_count; i++) {
+        worker_t *victim = &workers[(worker->id + i) % worker_count];
+
+        pthread_mutex_lock(&victim->lock);
+        found = steal_from(victim, task);
+        pthread_mutex_unlock(&victim->lock);
+
+        if (found) return true;
+    }
+
+    return false;
+}
+
+// Tasks left queued only for musicians being stepped elsewhere are retried
+// without sleeping, as those steps are short
+static void wait_for_work(worker_t *worker) {
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->head == worker->tail && executor_running) {
+        pthread_cond_wait(&worker->wake, &worker->lock);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static void flush_reports(worker_t *worker) {
+    report_batch_msg_t *batch = &worker->batch;
+    if (batch->count == 0) return;
+
+    init_msg_header(&batch->header, MSG_REPORT_BATCH, worker->id, batch->entries[0].sequence);
+
+    if (send_message(worker->batch_orchestra->coid_to_conductor, &batch->header,
+                     report_batch_size(batch->count), batch->count) == -1 &&
+        executor_running && program_running && worker->batch_orchestra->playing) {
+        printf("Worker %d: Could not send %d reports: %s\n",
+               worker->id, batch->count, strerror(errno));
+    }
+
+    batch->count = 0;
+}
+
+static void run_musician_step(worker_t *worker, musician_task_t *task) {
+    orchestra_t *orchestra = task->orchestra;
+    musician_t *musician = &orchestra->musicians[task->musician_id];
+    performance_t *performance = &orchestra->performances[musician->id];
+
+    switch (__atomic_load_n(&task->state, __ATOMIC_RELAXED)) {
+    case TASK_PULSE: {
+        update_musician_bpm(orchestra, musician, &task->tempo);
+        task->bpm = performance->perceived_bpm;
+
+        // Park the musician on the timing wheel until its note onset
+        task->onset_time_ns = task->pulse_time_ns +
+            (uint64_t)(MICROSECONDS_PER_MINUTE / task->bpm * 1000.0);
+        __atomic_store_n(&task->state, TASK_ONSET, __ATOMIC_RELAXED);
+        schedule_timer(&task->onset_timer, task->onset_time_ns);
+        break;
+    }
+
+    case TASK_ONSET: {
+        record_onset_lateness(monotonic_time_ns() - task->onset_time_ns);
+
+        // The report leaves later in the worker's batch, its lateness is the
+        // conductor's reports stage
+        beat_deadline_t deadline;
+        start_beat_deadline(&deadline, orchestra, musician, task->sequence, task->pulse_time_ns,
+                            task->onset_time_ns - task->pulse_time_ns);
+        check_deadline(&deadline, STAGE_ONSET);
+
+        performance->perceived_bpm = task->bpm;
+        follow_setlist(musician, performance, task->sequence);
+        play_note_with_viz(musician, task->sequence);
+        check_deadline(&deadline, STAGE_PLAY);
+
+        // Loop notes
+        performance->note_index = (performance->note_index + 1) % performance->note_count;
+        __atomic_store_n(&task->state, TASK_REPORT, __ATOMIC_RELAXED);
+    }
+        // fall through
+
+    case TASK_REPORT: {
+        // A batch only carries reports for one conductor
+        if (worker->batch_orchestra != orchestra) {
+            flush_reports(worker);
+            worker->batch_orchestra = orchestra;
+        }
+
+        // A flooding musician adds several copies
+        int copies = adversary_report_copies(orchestra, musician);
+        for (int i = 0; i < copies; i++) {
+            report_entry_t *entry = &worker->batch.entries[worker->batch.count++];
+            entry->sequence = task->sequence;
+            entry->musician_id = musician->id;
+            entry->reserved = 0;
+            entry->reported_bpm = task->bpm;
+
+            if (worker->batch.count == REPORT_BATCH_MAX) {
+                flush_reports(worker);
+            }
+        }
+        // Votes go straight to the conductor rather than waiting for the batch,
+        // sent before the slot is freed for the next pulse to reuse
+        send_adversary_vote(orchestra, musician, task->sequence, orchestra->coid_to_conductor);
+        __atomic_store_n(&task->state, TASK_IDLE, __ATOMIC_RELEASE);
+        break;
+    }
+
+    case TASK_IDLE:
+    default:
+        break;
+    }
+}
+
+static void* worker_thread(void *arg) {
+    worker_t *worker = (worker_t*) arg;
+    profile_thread(ROLE_WORKER);
+
+    // Pin each worker to its own core when there is one to spare
+    int cpu_count = _syspage_ptr->num_cpu;
+    if (cpu_count > 1 && cpu_count <= 32) {
+        ThreadCtl(_NTO_TCTL_RUNMASK, (void*)(uintptr_t)(1u << (worker->id % cpu_count)));
+    }
+
+    while (executor_running) {
+        musician_task_t *task;
+
+        if (next_task(worker, &task)) {
+            run_musician_step(worker, task);
+            sample_thread_cpu(&task->orchestra->performances[task->musician_id]);
+            release_musician(task);
+        } else {
+            flush_reports(worker);
+            wait_for_work(worker);
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+int initialize_executor(int requested_workers, int task_capacity);
+void shutdown_executor();
+int executor_attach_orchestra(orchestra_t *orchestra);
+void executor_detach_orchestra(orchestra_t *orchestra);
+int executor_post_pulse(orchestra_t *orchestra, int musician_id, const tempo_t *tempo);
+int executor_worker_count();
+void executor_dispatch_onsets(timer_entry_t **entries, int count);
+
+#endif
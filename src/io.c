@@ -1,30 +1,181 @@
 #include <byzantine_orchestra.h>
 
 int parse_arguments(int argc, char *argv[]) {
+	// Times batch scoring against the scalar path, instead of a concert
+	if (argc == 2 && strcmp(argv[1], "--benchmark-scoring") == 0) {
+		scoring_benchmark = true;
+		return 0;
+	}
+
 	if (argc < 2) {
-		printf("Usage: %s <num_musicians>\n", argv[0]);
+		printf("Usage: %s <num_musicians> [--executor [workers]] [--processes [count]] [--pipeline depth] [--tempo-tracker kalman|average] [--detector cusum|reputation] [--probation streak] [--quorum [size]] [--checkpoint file] [--resume file] [--degrade] [--concerts count] [--adversary strategy|all] [--audio file.wav|null|path] [--score file] [--setlist file]\n", argv[0]);
+		printf("       %s --benchmark-scoring\n", argv[0]);
 		return -1;
 	}
 
-    num_musicians = atoi(argv[1]);
-    if (num_musicians < MIN_MUSICIANS || num_musicians > MAX_MUSICIANS) {
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--executor") == 0) {
+			executor_mode = true;
+			// Optional worker count, defaults to one per CPU
+			if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+				executor_workers = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "--processes") == 0) {
+			process_mode = true;
+			// Optional process count, defaults to one per CPU
+			if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+				process_count = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+			pipeline_depth = atoi(argv[++i]);
+			if (pipeline_depth < 1 || pipeline_depth > MAX_PIPELINE_DEPTH) {
+				printf("Pipeline depth must be between 1 and %d\n", MAX_PIPELINE_DEPTH);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--quorum") == 0) {
+			quorum_mode = true;
+			// Optional quorum size, defaults to 2f+1 of the active musicians
+			if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+				quorum_size = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "--probation") == 0 && i + 1 < argc) {
+			// 0 makes a blacklist permanent
+			probation_streak = atoi(argv[++i]);
+			if (probation_streak < 0) {
+				printf("Probation streak cannot be negative\n");
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--degrade") == 0) {
+			// Shed status output, frames and votes when a beat deadline is threatened
+			degrade_mode = true;
+		} else if (strcmp(argv[i], "--concerts") == 0 && i + 1 < argc) {
+			// Independent concerts played at once on the shared executor
+			concert_count = atoi(argv[++i]);
+			if (concert_count < 1 || concert_count > MAX_CONCERTS) {
+				printf("Concert count must be between 1 and %d\n", MAX_CONCERTS);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--adversary") == 0 && i + 1 < argc) {
+			// Byzantine behaviour to benchmark, all plays each in its own concert
+			int strategy = 0;
+			i++;
+			while (strategy <= ADVERSARY_COUNT && strcmp(argv[i], adversary_name(strategy)) != 0) {
+				strategy++;
+			}
+			if (strategy > ADVERSARY_COUNT) {
+				printf("Adversary must be none, random, collude, drift, on-off, false-votes, flood or all\n");
+				return -1;
+			}
+			adversary_strategy = strategy;
+			adversary_benchmark = true;
+		} else if (strcmp(argv[i], "--score") == 0 && i + 1 < argc) {
+			// A text score or Standard MIDI File, instead of the menu
+			score_file = argv[++i];
+		} else if (strcmp(argv[i], "--setlist") == 0 && i + 1 < argc) {
+			// One score path per line, played in turn without stopping
+			setlist_file = argv[++i];
+		} else if (strcmp(argv[i], "--audio") == 0 && i + 1 < argc) {
+			// A .wav file, null to mix without keeping it, or any other path
+			// for raw 16-bit samples
+			audio_sink = argv[++i];
+		} else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			checkpoint_file = argv[++i];
+		} else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+			resume_file = argv[++i];
+		} else if (strcmp(argv[i], "--tempo-tracker") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "kalman") == 0) {
+				tempo_tracker_mode = TEMPO_TRACKER_KALMAN;
+			} else if (strcmp(argv[i], "average") == 0) {
+				tempo_tracker_mode = TEMPO_TRACKER_AVERAGE;
+			} else {
+				printf("Tempo tracker must be kalman or average\n");
+				return -1;
+			}
+		} else if (strcmp(argv[i], "--detector") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "cusum") == 0) {
+				detector_mode = DETECTOR_CUSUM;
+			} else if (strcmp(argv[i], "reputation") == 0) {
+				detector_mode = DETECTOR_REPUTATION;
+			} else {
+				printf("Detector must be cusum or reputation\n");
+				return -1;
+			}
+		} else {
+			printf("Unknown option: %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+    orchestra_size = atoi(argv[1]);
+    int max_musicians = (executor_mode || process_mode) ? MAX_ORCHESTRA_SIZE : MAX_MUSICIANS;
+    if (orchestra_size < MIN_MUSICIANS || orchestra_size > max_musicians) {
         printf("Number of musicians must be between %d and %d\n",
-               MIN_MUSICIANS, MAX_MUSICIANS);
+               MIN_MUSICIANS, max_musicians);
         return -1;
     }
 
+    // Musician processes run their own executors, --executor only sets their worker count
+    if (process_mode) {
+        executor_mode = false;
+    }
+
+    // Every strategy needs a concert of its own
+    if (adversary_strategy == ADVERSARY_COUNT && concert_count == 1) {
+        concert_count = ADVERSARY_COUNT;
+    }
+
+    // Musician processes and checkpoints belong to a single concert
+    if (concert_count > 1 && (process_mode || checkpoint_file != NULL || resume_file != NULL)) {
+        printf("--concerts cannot be combined with --processes, --checkpoint or --resume\n");
+        return -1;
+    }
+
+    // Musician processes play in their own address space, away from the mixer
+    if (audio_sink != NULL && process_mode) {
+        printf("--audio cannot be combined with --processes\n");
+        return -1;
+    }
+
+    // A checkpoint holds the position in one piece, and musician processes
+    // keep the score they were forked with
+    if (setlist_file != NULL && (process_mode || checkpoint_file != NULL || resume_file != NULL)) {
+        printf("--setlist cannot be combined with --processes, --checkpoint or --resume\n");
+        return -1;
+    }
+
+    // A resumed concert keeps checkpointing where it resumed from
+    if (resume_file != NULL && checkpoint_file == NULL) {
+        checkpoint_file = resume_file;
+    }
+
 	return 0;
 }
 
 const char* select_piece() {
+	static char path[1024];
+
+	// A score given with --score skips the menu
+	if (score_file != NULL) {
+		return score_file;
+	}
+
 	printf("Select a piece:\n");
 	printf("1. O Fortuna\n");
+	printf("2. Another score or MIDI file\n");
 	int piece_selection;
 	scanf("%d", &piece_selection);
 
 	switch (piece_selection) {
 	case 1:
 		return "../src/o_fortuna.txt";
+	case 2:
+		printf("Path: ");
+		if (scanf("%1023s", path) != 1) {
+			return NULL;
+		}
+		return path;
 	default:
 		printf("Invalid choice\n");
 		return NULL;
@@ -44,8 +195,15 @@ int read_notes_from_file(const char *filename,
 
 	char line[256];
 	int musician_index = 0;
+	int ignored_parts = 0;
 
 	while (fgets(line, sizeof(line), file)) {
+		// One part per line, capped at the musicians as notes are at MAX_NOTES
+		if (musician_index == MAX_MUSICIANS) {
+			ignored_parts++;
+			continue;
+		}
+
 		int i = strlen(line) - 1;
 		while (i >= 0 && (line[i] == ' ' || line[i] == '\n' || line[i] == '\r')) {
 			line[i] = '\0';
@@ -85,6 +243,10 @@ int read_notes_from_file(const char *filename,
 	}
 
 	fclose(file);
+	if (ignored_parts > 0) {
+		printf("%d more parts than the %d musicians were left out\n",
+		       ignored_parts, MAX_MUSICIANS);
+	}
 	// Return the number of musicians with notes
 	return musician_index;
 }
@@ -94,6 +256,7 @@ void free_notes_memory(const char *notes[MAX_MUSICIANS][MAX_NOTES]) {
 		for (int j = 0; j < MAX_NOTES; j++) {
 			if (notes[i][j] != NULL) {
 				free((void*) notes[i][j]);
+				notes[i][j] = NULL;
 			}
 		}
 	}
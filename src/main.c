@@ -1,21 +1,39 @@
 #include <byzantine_orchestra.h>
 
-musician_t musicians[MAX_MUSICIANS];
-int num_musicians = 0;
-double conductor_bpm = DEFAULT_BPM;
-double target_bpm = DEFAULT_BPM;
-int conductor_chid;
-int coids_to_musicians[MAX_MUSICIANS];
+int orchestra_size = 0;
+int concert_count = 1;
 volatile bool program_running = true;
-int byzantine_count = 0;
+bool executor_mode = false;
+int executor_workers = 0;
+bool process_mode = false;
+int process_count = 0;
+int pipeline_depth = 1;
+tempo_tracker_mode_t tempo_tracker_mode = TEMPO_TRACKER_KALMAN;
+detector_mode_t detector_mode = DETECTOR_CUSUM;
+adversary_strategy_t adversary_strategy = ADVERSARY_RANDOM;
+bool adversary_benchmark = false;
+bool scoring_benchmark = false;
+int probation_streak = DEFAULT_PROBATION_STREAK;
+bool quorum_mode = false;
+int quorum_size = 0;
+bool degrade_mode = false;
+const char *checkpoint_file = NULL;
+const char *resume_file = NULL;
+const char *audio_sink = NULL;
+const char *score_file = NULL;
+const char *setlist_file = NULL;
 
 const char *musician_names[MAX_MUSICIANS] = {
     "Melody", "Harmony", "Bass", "Counter-Melody",
     "Percussion", "Fill", "Rhythm"
 };
 
+// Played at once, orchestras[0] is the one drawn and printed
+static orchestra_t orchestras[MAX_CONCERTS];
+
 int main(int argc, char *argv[]) {
     srand(time(NULL)); // Seed random number
+    int descriptors_at_start = count_open_descriptors();
 
     program_running = true;
     viz_running = true;
@@ -24,24 +42,43 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    const char *filename = select_piece();
-    if (!filename) {
-        return -1;
+    // Needs no score or orchestra, only the reputation module
+    if (scoring_benchmark) {
+        return run_scoring_benchmark();
     }
 
-    if (initialize_orchestra(filename) != 0) {
-        printf("Could not initialize orchestra\n");
-        cleanup_resources();
-        return -1;
+    // A setlist plays its pieces in turn, otherwise one piece is chosen
+    if (setlist_file != NULL) {
+        if (load_setlist(setlist_file) != 0) {
+            return -1;
+        }
+    } else {
+        const char *filename = select_piece();
+        if (!filename || load_score(filename) != 0) {
+            return -1;
+        }
+    }
+
+    for (int c = 0; c < concert_count; c++) {
+        if (initialize_orchestra(&orchestras[c], c) != 0) {
+            printf("Could not initialize orchestra\n");
+            cleanup_resources(orchestras, c + 1);
+            return -1;
+        }
     }
 
-    if (initialize_visualization() != 0) {
-        printf("Could not initialize visualization\n");
-        cleanup_resources();
+    if (start_shared_services(orchestras, concert_count) != 0 ||
+        initialize_visualization(&orchestras[0]) != 0) {
+        printf("Could not start the orchestra\n");
+        cleanup_resources(orchestras, concert_count);
         return -1;
     }
 
-    pthread_t conductor;
+    if (concert_count > 1) {
+        printf("Playing %d concerts of %d musicians at once, printing the first\n",
+               concert_count, orchestra_size);
+    }
+
     pthread_attr_t attr;
     struct sched_param param;
 
@@ -52,23 +89,50 @@ int main(int argc, char *argv[]) {
     param.sched_priority = PRIORITY_CONDUCTOR;
 
     pthread_attr_setschedparam(&attr, &param);
-    if (pthread_create(&conductor, &attr, conductor_thread, NULL) != 0) {
-        perror("Could not create conductor thread");
-        pthread_attr_destroy(&attr);
-        cleanup_resources();
-        return -1;
+    uint64_t concert_start_ns = monotonic_time_ns();
+    int conductors = 0;
+    for (; conductors < concert_count; conductors++) {
+        orchestra_t *orchestra = &orchestras[conductors];
+        if (start_thread(&orchestra->conductor_thread, &attr, conductor_thread, orchestra) != 0) {
+            perror("Could not create conductor thread");
+            program_running = false;
+            break;
+        }
     }
     pthread_attr_destroy(&attr);
 
-    pthread_join(conductor, NULL);
-
-    program_running = false;
-    viz_running = false;
-
-    usleep(200000);
+    for (int c = 0; c < conductors; c++) {
+        pthread_join(orchestras[c].conductor_thread, NULL);
+    }
+    uint64_t concert_ns = monotonic_time_ns() - concert_start_ns;
+    record_concert_duration(concert_ns);
 
-    print_reputation_status();
+    if (conductors < concert_count) {
+        cleanup_resources(orchestras, concert_count);
+        return -1;
+    }
 
-    cleanup_resources();
-    return 0;
+    // Stop drawing and mixing before the summary, the rest is stopped after it
+    program_running = false;
+    uint64_t shutdown_start_ns = monotonic_time_ns();
+    shutdown_visualization();
+    stop_audio();
+    uint64_t shutdown_ns = monotonic_time_ns() - shutdown_start_ns;
+
+    print_reputation_status(&orchestras[0]);
+    print_detector_summary(&orchestras[0]);
+    print_telemetry_summary();
+    print_profile_summary(&orchestras[0], concert_ns);
+
+    shutdown_start_ns = monotonic_time_ns();
+    cleanup_resources(orchestras, concert_count);
+    shutdown_ns += monotonic_time_ns() - shutdown_start_ns;
+
+    // Every thread should have been joined and every descriptor closed
+    int threads_left = count_running_threads();
+    int descriptors_left = count_open_descriptors() - descriptors_at_start;
+    printf("Shutdown took %.1f us, %d threads still running, %d descriptors left open\n",
+           shutdown_ns / 1000.0, threads_left, descriptors_left);
+
+    return threads_left == 0 && descriptors_left == 0 ? 0 : -1;
 }
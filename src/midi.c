@@ -0,0 +1,393 @@
+#include <byzantine_orchestra.h>
+
+// Standard MIDI Files, format 0 and 1, read straight into the score musicians
+// play from: one note per part per beat. The file is streamed through one
+// MIDI_READ_BUFFER, and the only allocations are the note names stored in the
+// score, at most MAX_MUSICIANS * MAX_NOTES of them.
+//
+// Parts are the tracks of a format 1 file, or the channels of a format 0
+// one, in the order their first note appears. Each beat takes the highest
+// key sounding on it, or "R" for a rest. Beats are quarter notes for
+// metrical files. Tempo events are skipped since the conductor keeps its
+// own tempo, and SMPTE time is divided into beats at DEFAULT_BPM
+
+#define MIDI_KEYS 128
+#define MIDI_CHANNELS 16
+
+typedef struct {
+    FILE *file;
+    unsigned char buffer[MIDI_READ_BUFFER];
+    size_t length;
+    size_t position;
+    uint32_t chunk_left; // Bytes of the current chunk not yet read
+    bool failed; // Read past the end of the file or chunk
+} midi_stream_t;
+
+typedef struct {
+    uint32_t sounding[MIDI_KEYS / 32]; // Keys held down
+    int next_beat; // First beat not yet written
+} midi_part_t;
+
+typedef struct {
+    const char *(*notes)[MAX_NOTES];
+    midi_part_t parts[MAX_MUSICIANS];
+    int part_count;
+    int track_parts; // First part of the track being read
+    int channel_parts[MIDI_CHANNELS]; // Part of each channel in this track, or -1
+    int format;
+    double ticks_per_beat;
+    uint64_t events;
+    int ignored_parts; // Beyond MAX_MUSICIANS
+} midi_score_t;
+
+static int next_byte(midi_stream_t *stream) {
+    if (stream->chunk_left == 0) {
+        stream->failed = true;
+        return 0;
+    }
+
+    if (stream->position == stream->length) {
+        stream->length = fread(stream->buffer, 1, sizeof(stream->buffer), stream->file);
+        stream->position = 0;
+        if (stream->length == 0) {
+            stream->failed = true;
+            return 0;
+        }
+    }
+
+    stream->chunk_left--;
+    return stream->buffer[stream->position++];
+}
+
+// Big-endian, as every number in the file is
+static uint32_t read_number(midi_stream_t *stream, int bytes) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | next_byte(stream);
+    }
+    return value;
+}
+
+// Seven bits a byte, high bit set on all but the last, at most four bytes
+static uint32_t read_variable_length(midi_stream_t *stream) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int byte = next_byte(stream);
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) return value;
+    }
+
+    stream->failed = true;
+    return 0;
+}
+
+// Skips what is buffered, and seeks past the rest
+static void skip_bytes(midi_stream_t *stream, uint32_t count) {
+    if (count > stream->chunk_left) {
+        stream->failed = true;
+        return;
+    }
+    stream->chunk_left -= count;
+
+    size_t buffered = stream->length - stream->position;
+    if (count <= buffered) {
+        stream->position += count;
+        return;
+    }
+
+    stream->position = stream->length;
+    if (fseek(stream->file, (long)(count - buffered), SEEK_CUR) != 0) {
+        stream->failed = true;
+    }
+}
+
+static int highest_key(const midi_part_t *part) {
+    for (int word = MIDI_KEYS / 32 - 1; word >= 0; word--) {
+        if (part->sounding[word] != 0) {
+            return word * 32 + 31 - __builtin_clz(part->sounding[word]);
+        }
+    }
+    return -1;
+}
+
+// Scientific pitch names with sharps, middle C (key 60) is C4
+static char* key_name(int key) {
+    static const char *names[12] = {
+        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
+    };
+    char name[16];
+
+    if (key < 0) {
+        return strdup("R");
+    }
+    snprintf(name, sizeof(name), "%s%d", names[key % 12], key / 12 - 1);
+    return strdup(name);
+}
+
+// Write every beat of the track's parts that falls before tick
+static int write_beats_before(midi_score_t *score, double tick) {
+    for (int p = score->track_parts; p < score->part_count; p++) {
+        midi_part_t *part = &score->parts[p];
+        const char *note = NULL;
+
+        while (part->next_beat < MAX_NOTES && part->next_beat * score->ticks_per_beat < tick) {
+            // Held notes repeat the same name
+            if (note == NULL) {
+                note = key_name(highest_key(part));
+                if (note == NULL) return -1;
+            } else {
+                note = strdup(note);
+                if (note == NULL) return -1;
+            }
+            score->notes[p][part->next_beat++] = note;
+        }
+    }
+    return 0;
+}
+
+// Part of a channel's notes, started at its first note. -1 once every
+// musician has a part
+static int part_of_channel(midi_score_t *score, int channel) {
+    int key = score->format == 0 ? channel : 0;
+
+    if (score->channel_parts[key] >= 0) {
+        return score->channel_parts[key];
+    }
+
+    if (score->part_count == MAX_MUSICIANS) {
+        score->ignored_parts++;
+        score->channel_parts[key] = MAX_MUSICIANS; // Counted once
+        return -1;
+    }
+
+    int p = score->part_count++;
+    memset(&score->parts[p], 0, sizeof(score->parts[p]));
+    score->channel_parts[key] = p;
+    return p;
+}
+
+static void set_key(midi_score_t *score, int channel, int key, bool down) {
+    int p = part_of_channel(score, channel);
+    if (p < 0 || p >= MAX_MUSICIANS) return;
+
+    uint32_t bit = 1u << (key % 32);
+    if (down) {
+        score->parts[p].sounding[key / 32] |= bit;
+    } else {
+        score->parts[p].sounding[key / 32] &= ~bit;
+    }
+}
+
+static int read_track(midi_stream_t *stream, midi_score_t *score) {
+    double last_beat_tick = MAX_NOTES * score->ticks_per_beat;
+    uint64_t tick = 0;
+    int running_status = 0;
+
+    score->track_parts = score->part_count;
+    for (int c = 0; c < MIDI_CHANNELS; c++) {
+        score->channel_parts[c] = -1;
+    }
+
+    while (stream->chunk_left > 0 && !stream->failed) {
+        tick += read_variable_length(stream);
+
+        // Nothing later in the track reaches the score
+        if (tick >= last_beat_tick) break;
+
+        int status = next_byte(stream);
+        int data = 0;
+
+        if (status < 0x80) {
+            if (running_status == 0) {
+                stream->failed = true;
+                break;
+            }
+            data = status;
+            status = running_status;
+        } else if (status < 0xF0) {
+            running_status = status;
+            data = next_byte(stream);
+        }
+
+        if (status == 0xFF) {
+            int type = next_byte(stream);
+            uint32_t length = read_variable_length(stream);
+            skip_bytes(stream, length);
+            running_status = 0;
+            if (type == 0x2F) break; // End of track
+            continue;
+        } else if (status == 0xF0 || status == 0xF7) {
+            skip_bytes(stream, read_variable_length(stream));
+            running_status = 0;
+            continue;
+        } else if (status >= 0xF0) {
+            stream->failed = true;
+            break;
+        }
+
+        int kind = status & 0xF0;
+        int velocity = (kind == 0xC0 || kind == 0xD0) ? 0 : next_byte(stream);
+        score->events++;
+
+        if (kind != 0x80 && kind != 0x90) continue;
+
+        // Notes starting or ending on a beat are applied before it is written
+        if (write_beats_before(score, (double) tick) != 0) return -1;
+        set_key(score, status & 0x0F, data & 0x7F, kind == 0x90 && velocity > 0);
+    }
+
+    if (stream->failed) return -1;
+
+    // Notes still held run on to the end of the track
+    if (write_beats_before(score, fmin((double) tick, last_beat_tick)) != 0) return -1;
+    skip_bytes(stream, stream->chunk_left);
+    return 0;
+}
+
+bool is_midi_file(const char *filename) {
+    char magic[4];
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return false;
+
+    bool midi = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                memcmp(magic, "MThd", 4) == 0;
+    fclose(file);
+    return midi;
+}
+
+static int read_midi(midi_stream_t *stream, const char *filename,
+                     const char *notes[MAX_MUSICIANS][MAX_NOTES]) {
+    uint64_t start_ns = monotonic_time_ns();
+    midi_score_t score = { .notes = notes };
+    char id[4];
+
+    stream->file = fopen(filename, "rb");
+    if (stream->file == NULL) {
+        perror("Could not open MIDI file");
+        return -1;
+    }
+    stream->length = 0;
+    stream->position = 0;
+    stream->failed = false;
+
+    stream->chunk_left = 14;
+    for (int i = 0; i < 4; i++) {
+        id[i] = next_byte(stream);
+    }
+    uint32_t header_length = read_number(stream, 4);
+    score.format = read_number(stream, 2);
+    int track_count = read_number(stream, 2);
+    int division = read_number(stream, 2);
+
+    if (stream->failed || memcmp(id, "MThd", 4) != 0 || header_length < 6) {
+        printf("%s is not a MIDI file\n", filename);
+        fclose(stream->file);
+        return -1;
+    }
+    if (score.format > 1) {
+        printf("%s is a format %d MIDI file, only formats 0 and 1 can be played\n",
+               filename, score.format);
+        fclose(stream->file);
+        return -1;
+    }
+
+    if (division & 0x8000) {
+        // Frames per second (as a negative byte) and ticks per frame
+        int frames_per_second = -(int8_t)(division >> 8);
+        score.ticks_per_beat = frames_per_second * (division & 0xFF) * 60.0 / DEFAULT_BPM;
+    } else {
+        score.ticks_per_beat = division;
+    }
+    if (score.ticks_per_beat <= 0) {
+        printf("%s has no time division\n", filename);
+        fclose(stream->file);
+        return -1;
+    }
+
+    stream->chunk_left = header_length - 6;
+    skip_bytes(stream, stream->chunk_left);
+
+    int tracks_read = 0;
+    while (tracks_read < track_count && !stream->failed) {
+        stream->chunk_left = 8;
+        for (int i = 0; i < 4; i++) {
+            id[i] = next_byte(stream);
+        }
+        stream->chunk_left = read_number(stream, 4);
+        if (stream->failed) break;
+
+        // Chunks of unknown types are skipped, as the standard asks
+        if (memcmp(id, "MTrk", 4) != 0) {
+            skip_bytes(stream, stream->chunk_left);
+            continue;
+        }
+
+        if (read_track(stream, &score) != 0) {
+            break;
+        }
+        tracks_read++;
+    }
+    fclose(stream->file);
+
+    if (tracks_read < track_count) {
+        printf("MIDI file %s is malformed or truncated after %d of %d tracks\n",
+               filename, tracks_read, track_count);
+        free_notes_memory(notes);
+        return -1;
+    }
+    if (score.part_count == 0) {
+        printf("MIDI file %s has no notes\n", filename);
+        return -1;
+    }
+
+    int beats = 0;
+    for (int p = 0; p < score.part_count; p++) {
+        if (score.parts[p].next_beat > beats) {
+            beats = score.parts[p].next_beat;
+        }
+    }
+    // Notes that all start at tick 0 make parts without a single beat
+    if (beats == 0) {
+        printf("MIDI file %s has no notes\n", filename);
+        free_notes_memory(notes);
+        return -1;
+    }
+
+    // Parts that end early rest until the longest one ends, so they loop together
+    for (int p = 0; p < score.part_count; p++) {
+        for (int b = score.parts[p].next_beat; b < beats; b++) {
+            notes[p][b] = strdup("R");
+            if (notes[p][b] == NULL) {
+                perror("Could not allocate memory for note");
+                free_notes_memory(notes);
+                return -1;
+            }
+        }
+    }
+
+    printf("Read %d parts of %d beats from %s (format %d, %d tracks, %llu events) in %.2f ms\n",
+           score.part_count, beats, filename, score.format, track_count,
+           (unsigned long long) score.events, (monotonic_time_ns() - start_ns) / 1e6);
+    if (score.ignored_parts > 0) {
+        printf("%d more parts than the %d musicians were left out\n",
+               score.ignored_parts, MAX_MUSICIANS);
+    }
+    return score.part_count;
+}
+
+// Returns the number of parts read, -1 on error. Each call reads through a
+// buffer of its own, so the setlist preloader can read while the main
+// thread does
+int read_midi_score(const char *filename, const char *notes[MAX_MUSICIANS][MAX_NOTES]) {
+    midi_stream_t *stream = malloc(sizeof(*stream));
+    if (stream == NULL) {
+        perror("Could not allocate MIDI read buffer");
+        return -1;
+    }
+
+    int parts = read_midi(stream, filename, notes);
+    free(stream);
+    return parts;
+}
@@ -0,0 +1,10 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+// Bytes read from the file at a time, the parser never holds more
+#define MIDI_READ_BUFFER 4096
+
+bool is_midi_file(const char *filename);
+int read_midi_score(const char *filename, const char *notes[MAX_MUSICIANS][MAX_NOTES]);
+
+#endif
@@ -1,88 +1,198 @@
 #include <byzantine_orchestra.h>
 
+// Beats arrive as QNX pulses, anything else is answered and ignored
+typedef union {
+    struct _pulse pulse;
+    msg_header_t header;
+} musician_msg_t;
+
+// A pulse received but not yet played
+typedef struct {
+    int sequence;
+    double bpm;
+    uint64_t pulse_time_ns;
+    uint64_t onset_time_ns;
+} pending_onset_t;
+
+static void play_onset(musician_t *musician, const pending_onset_t *onset) {
+    orchestra_t *orchestra = musician->orchestra;
+    performance_t *performance = &orchestra->performances[musician->id];
+    uint64_t now = monotonic_time_ns();
+    record_onset_lateness(now > onset->onset_time_ns ? now - onset->onset_time_ns : 0);
+
+    beat_deadline_t deadline;
+    start_beat_deadline(&deadline, orchestra, musician, onset->sequence, onset->pulse_time_ns,
+                        onset->onset_time_ns - onset->pulse_time_ns);
+    check_deadline(&deadline, STAGE_ONSET);
+
+    performance->perceived_bpm = onset->bpm;
+    follow_setlist(musician, performance, onset->sequence);
+    play_note_with_viz(musician, onset->sequence);
+    check_deadline(&deadline, STAGE_PLAY);
+
+    // Loop notes
+    performance->note_index = (performance->note_index + 1) % performance->note_count;
+
+    // Report back to conductor, tagged with the pulse being answered. A
+    // flooding musician sends it several times
+    report_msg_t report = { .reported_bpm = onset->bpm };
+    int copies = adversary_report_copies(orchestra, musician);
+
+    for (int i = 0; i < copies; i++) {
+        init_msg_header(&report.header, MSG_REPORT, musician->id, onset->sequence);
+
+        // Sends fail once the concert has ended and destroyed the conductor channel
+        if (send_message(musician->coid_to_conductor, &report.header, sizeof(report), 1) == -1) {
+            if (program_running && orchestra->playing) {
+                printf("%s: Could not send report: %s\n", musician->name, strerror(errno));
+            }
+            break;
+        }
+    }
+    send_adversary_vote(orchestra, musician, onset->sequence, musician->coid_to_conductor);
+    check_deadline(&deadline, STAGE_REPORT);
+
+    // Everything the thread did since the last pulse was for this musician
+    sample_thread_cpu(performance);
+}
+
 void* musician_thread(void* arg) {
     musician_t *musician = (musician_t*) arg;
-    struct timespec start_time, end_time;
-    double elapsed_time;
-    double wait_time;
+    orchestra_t *orchestra = musician->orchestra;
+    const performance_t *performance = &orchestra->performances[musician->id];
+    pending_onset_t pending[MAX_PIPELINE_DEPTH];
+    int pending_count = 0;
+    profile_thread(ROLE_MUSICIAN);
 
     while (program_running) {
-        // Wait for message from conductor
-        pulse_msg_t msg;
-        int rcvid = MsgReceive(musician->chid, &msg, sizeof(msg), NULL);
+        // Play every onset that is due, earliest first
+        while (pending_count > 0) {
+            int next = 0;
+            for (int i = 1; i < pending_count; i++) {
+                if (pending[i].onset_time_ns < pending[next].onset_time_ns) {
+                    next = i;
+                }
+            }
+            if (pending[next].onset_time_ns > monotonic_time_ns()) break;
 
-        if (rcvid == -1 && errno != EINTR) {
-            printf("%s: Receive error: %s\n", musician->name, strerror(errno));
-            continue;
+            pending_onset_t onset = pending[next];
+            pending[next] = pending[--pending_count];
+            play_onset(musician, &onset);
         }
 
-        // Record start time for next note
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
-
-        // Process the message
-        if (msg.type == 1) { // Pulse
-            bool byzantine_timing = false;
-
-            if (musician->is_byzantine && rand() % 100 < (BYZANTINE_BEHAVIOR_CHANCE * 100)) {
-                byzantine_timing = true;
+        // Wait for the next pulse, but no longer than the next onset
+        if (pending_count > 0) {
+            uint64_t earliest = pending[0].onset_time_ns;
+            for (int i = 1; i < pending_count; i++) {
+                if (pending[i].onset_time_ns < earliest) {
+                    earliest = pending[i].onset_time_ns;
+                }
             }
+            uint64_t now = monotonic_time_ns();
+            uint64_t timeout = earliest > now ? earliest - now : 0;
+            TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_RECEIVE, NULL, &timeout, NULL);
+        }
 
-            update_musician_bpm(musician, byzantine_timing);
-
-            MsgReply(rcvid, EOK, NULL, 0);
-
-            // Calculate how long to wait based on perceived BPM
-            double target_time = MICROSECONDS_PER_MINUTE / musician->perceived_bpm;
-
-            // Calculate elapsed time since receiving the message
-            clock_gettime(CLOCK_MONOTONIC, &end_time);
-            elapsed_time = (end_time.tv_sec - start_time.tv_sec) * 1000000.0 +
-                             (end_time.tv_nsec - start_time.tv_nsec) / 1000.0;
+        musician_msg_t msg;
+        int rcvid = MsgReceive(musician->chid, &msg, sizeof(msg), NULL);
 
-            // Wait for the remaining time
-            if (elapsed_time < target_time) {
-                wait_time = target_time - elapsed_time;
-                usleep((useconds_t)wait_time);
+        if (rcvid == -1) {
+            if (errno != ETIMEDOUT && errno != EINTR) {
+                printf("%s: Receive error: %s\n", musician->name, strerror(errno));
             }
+            continue;
+        }
 
-            play_note_with_viz(musician);
-
-            // Loop notes
-            musician->note_index = (musician->note_index + 1) % MAX_NOTES;
-
-            // Report back to conductor
-            pulse_msg_t report = {
-                .type = 2,
-                .musician_id = musician->id,
-                .reported_bpm = musician->perceived_bpm
-            };
-
-            if (MsgSend(musician->coid_to_conductor, &report, sizeof(report), NULL, 0) == -1) {
-                printf("%s: Could not send report: %s\n", musician->name, strerror(errno));
+        // Process the message
+        if (rcvid != 0) {
+            MsgError(rcvid, ENOTSUP);
+        } else if (msg.pulse.code == PULSE_CODE_STOP) {
+            break;
+        } else if (msg.pulse.code != PULSE_CODE_BEAT) {
+            continue;
+        } else if (pending_count == MAX_PIPELINE_DEPTH) {
+            // Still playing every pulse already in flight. The conductor is
+            // told, so the beat stops waiting for a report that never comes
+            int sequence = msg.pulse.value.sival_int;
+            MsgSendPulse(musician->coid_to_conductor, -1, PULSE_CODE_DROPPED,
+                         sequence * MAX_MUSICIANS + musician->id);
+            if (orchestra->verbose && !is_large_orchestra(orchestra)) {
+                printf("%s: Dropping pulse %d, still playing %d earlier pulses\n",
+                       musician->name, sequence + 1, pending_count);
             }
         } else {
-            MsgReply(rcvid, EOK, NULL, 0);
+            uint64_t received_ns = monotonic_time_ns();
+            int sequence = msg.pulse.value.sival_int;
+            tempo_t tempo = read_tempo(&orchestra->pulse_tempos[sequence % BEAT_HISTORY]);
+
+            // So far behind that the pulse's slot was reused, play the latest tempo
+            if (tempo.sequence != sequence) {
+                tempo = read_tempo(&orchestra->tempo);
+                tempo.sequence = sequence;
+            }
+            update_musician_bpm(orchestra, musician, &tempo);
+
+            // Note onset one beat after the pulse at the perceived tempo
+            pending[pending_count].sequence = sequence;
+            pending[pending_count].bpm = performance->perceived_bpm;
+            pending[pending_count].pulse_time_ns = received_ns;
+            pending[pending_count].onset_time_ns = received_ns +
+                (uint64_t)(MICROSECONDS_PER_MINUTE / performance->perceived_bpm * 1000.0);
+            pending_count++;
         }
     }
 
     return NULL;
 }
 
-void update_musician_bpm(musician_t *musician, bool byzantine_timing) {
+// Played at the tempo the pulse carried. Byzantine musicians play whatever
+// their concert's adversary strategy says
+void update_musician_bpm(orchestra_t *orchestra, const musician_t *musician, const tempo_t *tempo) {
+	performance_t *performance = &orchestra->performances[musician->id];
 	deviation_type_t deviation_type;
 
-	if (musician->is_byzantine && byzantine_timing) {
-		deviation_type = DEVIATION_BYZANTINE;
-	} else if (musician->is_first_chair) {
+	// The first pulse of a new tempo times how long it took to reach the musician
+	if (tempo->epoch != performance->tempo_epoch) {
+		performance->tempo_epoch = tempo->epoch;
+		record_tempo_lag(monotonic_time_ns() - tempo->set_ns);
+	}
+
+	// Where reading the shared tempo would have played the wrong one. Musician
+	// processes have no current tempo to compare with
+	if (!process_mode && read_tempo(&orchestra->tempo).epoch != tempo->epoch) {
+		count_event(COUNTER_TEMPO_SUPERSEDED);
+	}
+
+	if (adversary_tempo(orchestra, musician, tempo, &performance->perceived_bpm)) {
+		return;
+	}
+
+	if (musician->is_first_chair) {
 		deviation_type = DEVIATION_FIRST_CHAIR;
 	} else {
 		deviation_type = DEVIATION_NORMAL;
 	}
 
-	musician->perceived_bpm = add_variance(conductor_bpm, deviation_type);
+	performance->perceived_bpm = add_variance(tempo->bpm, deviation_type);
 }
 
-void play_note(musician_t *musician) {
+void play_note(orchestra_t *orchestra, const musician_t *musician, int sequence) {
+    const performance_t *performance = &orchestra->performances[musician->id];
+
+    if (audio_sink != NULL) {
+        audio_note_on(orchestra, performance->notes[performance->note_index],
+                      performance->perceived_bpm, sequence);
+    }
+
+    // Per-note output would swamp the terminal for large orchestras, and is
+    // the first thing dropped under --degrade
+    if (!orchestra->verbose || is_large_orchestra(orchestra) ||
+        should_shed(orchestra, SHED_NOTE_LINES)) {
+        add_note_event(orchestra, performance->notes[performance->note_index],
+                       performance->perceived_bpm, musician->id);
+        return;
+    }
+
     const char *status = musician->is_byzantine ? "[BYZANTINE]" : "";
 
     if (musician->is_first_chair && musician->is_byzantine) {
@@ -95,13 +205,14 @@ void play_note(musician_t *musician) {
 
     if (musician->is_byzantine || musician->is_first_chair) {
         printf("%s %s: Playing %s at %.1f BPM\n",
-                musician->name, status, musician->notes[musician->note_index],
-                musician->perceived_bpm);
+                musician->name, status, performance->notes[performance->note_index],
+                performance->perceived_bpm);
     } else {
         printf("%s: Playing %s at %.1f BPM\n", musician->name,
-                musician->notes[musician->note_index], musician->perceived_bpm);
+                performance->notes[performance->note_index], performance->perceived_bpm);
     }
-    add_note_event(musician->notes[musician->note_index], musician->perceived_bpm, musician->id);
+    add_note_event(orchestra, performance->notes[performance->note_index],
+                   performance->perceived_bpm, musician->id);
 }
 
 
@@ -2,8 +2,8 @@
 #define MUSICIAN_H
 
 void* musician_thread(void* arg);
-void update_musician_bpm(musician_t *musician, bool byzantine_timing);
-void play_note(musician_t *musician);
+void update_musician_bpm(orchestra_t *orchestra, const musician_t *musician, const tempo_t *tempo);
+void play_note(orchestra_t *orchestra, const musician_t *musician, int sequence);
 double add_variance(double bpm, deviation_type_t deviation_type);
 void cast_reputation_votes(musician_t *voter);
 
@@ -1,118 +1,384 @@
 #include <byzantine_orchestra.h>
 
-int initialize_orchestra(const char *filename) {
-    const char *notes[MAX_MUSICIANS][MAX_NOTES];
+uint64_t monotonic_time_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+bool is_large_orchestra(const orchestra_t *orchestra) {
+    return orchestra->num_musicians > MAX_MUSICIANS;
+}
+
+// Threads started through start_thread that have not returned yet
+static int running_threads = 0;
+
+typedef struct {
+    void *(*routine)(void *);
+    void *arg;
+} thread_start_t;
+
+static void* counted_thread(void *arg) {
+    thread_start_t start = *(thread_start_t*) arg;
+    free(arg);
+
+    profile_thread(ROLE_SERVICE);
+    void *result = start.routine(start.arg);
+    finish_thread_profile();
+    __atomic_sub_fetch(&running_threads, 1, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+// pthread_create, counting the thread until it returns so shutdown can
+// check that none is left behind
+int start_thread(pthread_t *thread, const pthread_attr_t *attr,
+                 void *(*routine)(void *), void *arg) {
+    thread_start_t *start = malloc(sizeof(*start));
+    if (start == NULL) return ENOMEM;
+
+    start->routine = routine;
+    start->arg = arg;
+
+    __atomic_add_fetch(&running_threads, 1, __ATOMIC_SEQ_CST);
+    int error = pthread_create(thread, attr, counted_thread, start);
+    if (error != 0) {
+        __atomic_sub_fetch(&running_threads, 1, __ATOMIC_SEQ_CST);
+        free(start);
+    }
+    return error;
+}
 
-    if (read_notes_from_file(filename, musician_names, notes) == -1) {
-        printf("Could not read notes from file\n");
+// Join a thread that has been told to stop, giving up after SHUTDOWN_JOIN_TIMEOUT_NS
+int join_thread(pthread_t thread, const char *name) {
+    uint64_t deadline_ns = monotonic_time_ns() + SHUTDOWN_JOIN_TIMEOUT_NS;
+    struct timespec deadline = {
+        .tv_sec = deadline_ns / 1000000000ULL,
+        .tv_nsec = deadline_ns % 1000000000ULL
+    };
+
+    int error = pthread_timedjoin_monotonic(thread, NULL, &deadline);
+    if (error != 0) {
+        printf("Shutdown: %s thread did not stop: %s\n", name, strerror(error));
         return -1;
     }
+    return 0;
+}
 
-    assign_byzantine_musicians();
-    initialize_reputation_system();
+int count_running_threads() {
+    return __atomic_load_n(&running_threads, __ATOMIC_SEQ_CST);
+}
+
+int count_open_descriptors() {
+    int open_descriptors = 0;
+    long max_descriptors = sysconf(_SC_OPEN_MAX);
+
+    for (int fd = 0; fd < max_descriptors; fd++) {
+        if (fcntl(fd, F_GETFD) != -1) {
+            open_descriptors++;
+        }
+    }
+    return open_descriptors;
+}
+
+static void* aligned_array(size_t count, size_t size) {
+    void *array = NULL;
+
+    if (posix_memalign(&array, CACHE_LINE_SIZE, count * size) != 0) {
+        return NULL;
+    }
+    memset(array, 0, count * size);
+    return array;
+}
 
-    printf("Byzantine Orchestra starting with %d musicians at %.1f BPM\n",
-           num_musicians, conductor_bpm);
+// Set up one concert of orchestra_size musicians, the first one prints its beats
+int initialize_orchestra(orchestra_t *orchestra, int id) {
+    int num_musicians = orchestra_size;
 
-    conductor_chid = ChannelCreate(0);
-    if (conductor_chid == -1) {
+    orchestra->id = id;
+    // Every strategy at once runs quietly so their conductor times compare
+    orchestra->verbose = (id == 0 && adversary_strategy != ADVERSARY_COUNT);
+    orchestra->num_musicians = num_musicians;
+    orchestra->adversary = concert_adversary(id);
+    orchestra->conductor_bpm = DEFAULT_BPM;
+    orchestra->target_bpm = DEFAULT_BPM;
+    orchestra->playing = true;
+    orchestra->tempo_window.change = -1;
+    orchestra->tempo_window.settled_from = -1;
+    initialize_tempo_tracker(&orchestra->tempo_tracker);
+    pthread_mutex_init(&orchestra->reputation_mutex, NULL);
+
+    // Written by different threads on every pulse, so kept apart on their own cache lines
+    orchestra->musicians = calloc(num_musicians, sizeof(musician_t));
+    orchestra->performances = aligned_array(num_musicians, sizeof(performance_t));
+    orchestra->standings = aligned_array(num_musicians, sizeof(standing_t));
+    orchestra->vote_tally = calloc(2 * num_musicians, sizeof(int));
+    orchestra->vote_capacity = VOTE_BUFFER_PER_MUSICIAN * num_musicians;
+    orchestra->vote_buffer = malloc(orchestra->vote_capacity * sizeof(reputation_vote_t));
+    if (orchestra->musicians == NULL || orchestra->performances == NULL ||
+        orchestra->standings == NULL || orchestra->vote_tally == NULL ||
+        orchestra->vote_buffer == NULL) {
+        perror("Could not allocate orchestra");
+        return -1;
+    }
+
+    for (int i = 0; i < num_musicians; i++) {
+        orchestra->performances[i].perceived_bpm = orchestra->conductor_bpm;
+        orchestra->performances[i].note_index = 0;
+        orchestra->performances[i].piece = 0;
+    }
+
+    // A resumed concert keeps its byzantine musicians and what was learnt about them
+    if (resume_file != NULL) {
+        if (restore_checkpoint(orchestra, resume_file) != 0) {
+            return -1;
+        }
+    } else {
+        assign_byzantine_musicians(orchestra);
+        initialize_reputation_system(orchestra);
+    }
+    pair_byzantine_musicians(orchestra);
+
+    // The tempo musicians start from, or the one a checkpoint restored
+    tempo_t tempo = { .bpm = orchestra->conductor_bpm, .set_ns = monotonic_time_ns() };
+    write_tempo(&orchestra->tempo, &tempo);
+
+    if (orchestra->verbose) {
+        printf("Byzantine Orchestra starting with %d musicians at %.1f BPM\n",
+               num_musicians, orchestra->conductor_bpm);
+        if (orchestra->adversary != ADVERSARY_RANDOM) {
+            printf("Byzantine musicians play the %s strategy\n", adversary_name(orchestra->adversary));
+        }
+    }
+
+    orchestra->conductor_chid = ChannelCreate(0);
+    if (orchestra->conductor_chid == -1) {
         perror("Could not create conductor channel");
         return -1;
     }
 
-    if (initialize_musicians(notes) != 0) {
-        free_notes_memory(notes);
+    orchestra->coid_to_conductor = ConnectAttach(0, 0, orchestra->conductor_chid,
+                                                 _NTO_SIDE_CHANNEL, 0);
+    if (orchestra->coid_to_conductor == -1) {
+        perror("Could not create connection to conductor");
         return -1;
     }
 
-    return 0;
+    if (initialize_conductor(orchestra) != 0) {
+        return -1;
+    }
+
+    // Musician processes are forked before the timer thread starts
+    return initialize_musicians(orchestra);
 }
 
-int initialize_musicians(const char *notes[MAX_MUSICIANS][MAX_NOTES]) {
-    for (int i = 0; i < num_musicians; i++) {
-        musicians[i].id = i;
-        musicians[i].perceived_bpm = conductor_bpm;
-        musicians[i].notes = notes[i];
-        musicians[i].note_index = 0;
-        musicians[i].name = musician_names[i];
-        musicians[i].is_first_chair = (i == 0);
-        musicians[i].is_blacklisted = false;
-        musicians[i].reputation = INITIAL_REPUTATION;
-        musicians[i].last_reported_bpm = conductor_bpm;
-        musicians[i].blacklist_time = 0;
-
-        musicians[i].chid = ChannelCreate(0);
-        if (musicians[i].chid == -1) {
+int initialize_musicians(orchestra_t *orchestra) {
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        musician_t *musician = &orchestra->musicians[i];
+
+        musician->id = i;
+        musician->orchestra = orchestra;
+        assign_part(&orchestra->performances[i], i, 0);
+        musician->name = musician_names[i % MAX_MUSICIANS];
+        musician->is_first_chair = (i == 0);
+        // Resumed from a checkpoint of a score with more notes
+        orchestra->performances[i].note_index %= orchestra->performances[i].note_count;
+
+        // Executor and process mode musicians have no thread or channel of their own
+        if (executor_mode || process_mode) {
+            continue;
+        }
+
+        musician->chid = ChannelCreate(0);
+        if (musician->chid == -1) {
             perror("Could not create musician channel");
             return -1;
         }
 
-        musicians[i].coid_to_conductor = ConnectAttach(0, 0, conductor_chid, 0, 0);
-        if (musicians[i].coid_to_conductor == -1) {
+        musician->coid_to_conductor = ConnectAttach(0, 0, orchestra->conductor_chid, 0, 0);
+        if (musician->coid_to_conductor == -1) {
             perror("Could not create connection to conductor");
             return -1;
         }
 
-        coids_to_musicians[i] = ConnectAttach(0, 0, musicians[i].chid, 0, 0);
-        if (coids_to_musicians[i] == -1) {
+        orchestra->coids_to_musicians[i] = ConnectAttach(0, 0, musician->chid, 0, 0);
+        if (orchestra->coids_to_musicians[i] == -1) {
             perror("Conductor could not create connection to musician");
             return -1;
         }
 
-        pthread_create(&musicians[i].thread, NULL, musician_thread, &musicians[i]);
+        start_thread(&musician->thread, NULL, musician_thread, musician);
+    }
+
+    // Executor musicians are attached once the shared pool is running
+    if (process_mode) {
+        return launch_musician_processes(orchestra, process_count);
     }
     return 0;
 }
 
-void assign_byzantine_musicians() {
+// The executor's workers and the timing wheel serve every concert
+int start_shared_services(orchestra_t *orchestras, int count) {
+    int task_capacity = 0;
+
+    if (executor_mode) {
+        for (int c = 0; c < count; c++) {
+            task_capacity += orchestras[c].num_musicians * MAX_PIPELINE_DEPTH;
+        }
+
+        if (initialize_executor(executor_workers, task_capacity) != 0) {
+            return -1;
+        }
+        for (int c = 0; c < count; c++) {
+            if (executor_attach_orchestra(&orchestras[c]) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    if (initialize_timing_wheel(task_capacity) != 0) {
+        return -1;
+    }
+
+    if (checkpoint_file != NULL && start_checkpoint_writer(&orchestras[0], checkpoint_file) != 0) {
+        return -1;
+    }
+
+    if (start_setlist(orchestras, count) != 0) {
+        return -1;
+    }
+
+    // Every concert's musicians play into the one mix
+    if (audio_sink != NULL && start_audio(audio_sink, count * orchestra_size) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void assign_byzantine_musicians(orchestra_t *orchestra) {
+    musician_t *musicians = orchestra->musicians;
+    int num_musicians = orchestra->num_musicians;
+
     // Maximum n number of Byzantine musicians for 3n+1 musicians
-    int max_byzantine = (num_musicians == 7) ? 2 : 1;
+    int max_byzantine = (num_musicians - 1) / 3;
 
-    // At least 1 Byzantine, but no more than max_byzantine
-    byzantine_count = 1 + (rand() % max_byzantine);
+    // At least 1 Byzantine, but no more than max_byzantine. A benchmark
+    // gives every strategy the most, so colluders have partners
+    orchestra->byzantine_count = adversary_benchmark ? max_byzantine : 1 + (rand() % max_byzantine);
 
     for (int i = 0; i < num_musicians; i++) {
         musicians[i].is_byzantine = false;
     }
 
-    for (int i = 0; i < byzantine_count; i++) {
+    for (int i = 0; i < orchestra->byzantine_count; i++) {
         int index;
         do {
             index = rand() % num_musicians;
         } while (musicians[index].is_byzantine);
 
         musicians[index].is_byzantine = true;
-        printf("%s will be a byzantine musician\n", musician_names[index]);
+        if (orchestra->verbose && !is_large_orchestra(orchestra)) {
+            printf("%s will be a byzantine musician\n", musician_names[index]);
+        }
+    }
+
+    if (orchestra->verbose && is_large_orchestra(orchestra)) {
+        printf("%d of %d musicians will be byzantine\n", orchestra->byzantine_count, num_musicians);
     }
 }
 
-void cleanup_resources() {
-    program_running = false;
-    viz_running = false;
+// Stop one concert's musician threads, with its conductor channel already destroyed
+static void stop_musician_threads(orchestra_t *orchestra) {
+    // Only thread-per-musician mode owns musician threads and channels
+    if (executor_mode || process_mode || orchestra->musicians == NULL) return;
 
-    usleep(100000);
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        musician_t *musician = &orchestra->musicians[i];
 
-    for (int i = 0; i < num_musicians; i++) {
-        if (musicians[i].thread != 0) {
-            pthread_cancel(musicians[i].thread);
-            pthread_join(musicians[i].thread, NULL);
+        // One that did not stop keeps its channel and connections
+        if (musician->thread != 0 && join_thread(musician->thread, musician->name) != 0) {
+            continue;
         }
 
-        if (musicians[i].coid_to_conductor != 0) {
-            ConnectDetach(musicians[i].coid_to_conductor);
+        if (musician->coid_to_conductor > 0) {
+            ConnectDetach(musician->coid_to_conductor);
         }
-        if (coids_to_musicians[i] != 0) {
-            ConnectDetach(coids_to_musicians[i]);
+        if (orchestra->coids_to_musicians[i] > 0) {
+            ConnectDetach(orchestra->coids_to_musicians[i]);
         }
 
-        if (musicians[i].chid != 0) {
-            ChannelDestroy(musicians[i].chid);
+        if (musician->chid > 0) {
+            ChannelDestroy(musician->chid);
         }
     }
+}
 
-    if (conductor_chid != 0) {
-        ChannelDestroy(conductor_chid);
+static void release_orchestra(orchestra_t *orchestra) {
+    if (executor_mode) {
+        executor_detach_orchestra(orchestra);
     }
+    release_conductor(orchestra);
+    release_visualization(orchestra);
+
+    if (orchestra->coid_to_conductor > 0) {
+        ConnectDetach(orchestra->coid_to_conductor);
+    }
+    if (orchestra->num_musicians > 0) {
+        cleanup_reputation_system(orchestra);
+    }
+
+    free(orchestra->musicians);
+    free(orchestra->performances);
+    free(orchestra->standings);
+    free(orchestra->vote_tally);
+    free(orchestra->vote_buffer);
+    orchestra->musicians = NULL;
+    orchestra->performances = NULL;
+    orchestra->standings = NULL;
+    orchestra->vote_tally = NULL;
+    orchestra->vote_buffer = NULL;
+}
+
+// Also called on concerts only partly set up
+void cleanup_resources(orchestra_t *orchestras, int count) {
+    program_running = false;
+    shutdown_visualization();
 
-    cleanup_reputation_system();
+    // Wake musicians waiting for a pulse, and release any blocked sending a
+    // report by destroying the channel it was sent to
+    for (int c = 0; c < count; c++) {
+        orchestra_t *orchestra = &orchestras[c];
+        bool threaded = !executor_mode && !process_mode && orchestra->musicians != NULL;
+
+        for (int i = 0; threaded && i < orchestra->num_musicians; i++) {
+            if (orchestra->coids_to_musicians[i] > 0) {
+                MsgSendPulse(orchestra->coids_to_musicians[i], -1, PULSE_CODE_STOP, 0);
+            }
+        }
+
+        if (orchestra->conductor_chid > 0) {
+            ChannelDestroy(orchestra->conductor_chid);
+            orchestra->conductor_chid = 0;
+        }
+    }
+
+    for (int c = 0; c < count; c++) {
+        stop_musician_threads(&orchestras[c]);
+    }
+
+    // Workers blocked reporting to a conductor were released by the destroy
+    if (executor_mode) {
+        shutdown_executor();
+    }
+    if (process_mode) {
+        shutdown_musician_processes();
+    }
+    shutdown_timing_wheel();
+    stop_checkpoint_writer();
+    stop_audio();
+
+    for (int c = 0; c < count; c++) {
+        release_orchestra(&orchestras[c]);
+    }
+    stop_setlist();
 }
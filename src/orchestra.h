@@ -1,9 +1,62 @@
 #ifndef ORCHESTRA_H
 #define ORCHESTRA_H
 
-int initialize_orchestra(const char *filename);
-int initialize_musicians(const char *notes[MAX_MUSICIANS][MAX_NOTES]);
-void assign_byzantine_musicians();
-void cleanup_resources();
+// One concert: its musicians, what its conductor has learnt about them and
+// its tempo. Several can play at once, sharing the executor's workers and
+// the timing wheel
+struct orchestra {
+    int id;
+    bool verbose; // Only the first of several concerts prints its beats
+    int num_musicians;
+    int byzantine_count;
+    adversary_strategy_t adversary;
+    uint64_t adversary_seed; // Shared by its byzantine musicians, see adversary.c
+    musician_t *musicians;
+    performance_t *performances;
+    standing_t *standings;
+    double conductor_bpm; // The conductor's own, set with set_concert_tempo
+    double target_bpm;
+    // The conductor_bpm for every other thread, and the tempo each pulse in
+    // the history was sent at
+    tempo_record_t tempo;
+    tempo_record_t pulse_tempos[BEAT_HISTORY];
+    int pulses_sent; // Written only by the conductor
+    int piece; // Of the setlist, see setlist.c
+    // When each beat in the history should sound, written before its pulse is sent
+    uint64_t beat_onsets_ns[BEAT_HISTORY];
+    pthread_t conductor_thread;
+    volatile bool playing; // Cleared once the conductor stops taking reports
+    int conductor_chid;
+    int coid_to_conductor; // Side channel for executor workers and report deadlines
+    int coids_to_musicians[MAX_MUSICIANS];
+    // Guards the standings and votes
+    pthread_mutex_t reputation_mutex;
+    reputation_vote_t *vote_buffer; // VOTE_BUFFER_PER_MUSICIAN per musician
+    int vote_count;
+    int vote_capacity;
+    int *vote_tally; // Scratch for process_reputation_votes, two per musician
+    tempo_tracker_t tempo_tracker;
+    tempo_window_t tempo_window;
+    // Load shedding under --degrade, kept per concert
+    volatile bool overrunning;
+    volatile bool shedding;
+    // State private to the conductor, executor and visualization
+    struct conductor_state *conductor;
+    struct musician_task *tasks;
+    struct raster *raster;
+};
+
+int initialize_orchestra(orchestra_t *orchestra, int id);
+int initialize_musicians(orchestra_t *orchestra);
+int start_shared_services(orchestra_t *orchestras, int count);
+void assign_byzantine_musicians(orchestra_t *orchestra);
+void cleanup_resources(orchestra_t *orchestras, int count);
+uint64_t monotonic_time_ns();
+bool is_large_orchestra(const orchestra_t *orchestra);
+int start_thread(pthread_t *thread, const pthread_attr_t *attr,
+                 void *(*routine)(void *), void *arg);
+int join_thread(pthread_t thread, const char *name);
+int count_running_threads();
+int count_open_descriptors();
 
 #endif
@@ -0,0 +1,459 @@
+#include <byzantine_orchestra.h>
+
+// Each musician process plays a contiguous group of musicians and talks to
+// the conductor process over its own Unix domain socket
+typedef struct {
+    int id;
+    orchestra_t *orchestra;
+    pid_t pid;
+    int fd;
+    int first_musician;
+    int musician_count;
+    pthread_t link_thread;
+    bool link_started;
+    volatile bool alive;
+} process_group_t;
+
+// Any message that can cross a socket
+typedef union {
+    msg_header_t header;
+    pulse_msg_t pulse;
+    report_msg_t report;
+    vote_msg_t vote;
+    dismiss_msg_t dismiss;
+    dropped_msg_t dropped;
+    report_batch_msg_t report_batch;
+    vote_batch_msg_t vote_batch;
+} wire_msg_t;
+
+static process_group_t groups[MAX_PROCESSES];
+static int group_count = 0;
+// Blacklisted musicians whose process has been told to stop pulsing them
+static bool dismissed[MAX_ORCHESTRA_SIZE];
+
+static int write_full(int fd, const void *buffer, size_t bytes) {
+    const char *data = buffer;
+
+    while (bytes > 0) {
+        ssize_t written = write(fd, data, bytes);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        bytes -= written;
+    }
+    return 0;
+}
+
+// Returns 1 when the buffer was filled, 0 at end of stream and -1 on error
+static int read_full(int fd, void *buffer, size_t bytes) {
+    char *data = buffer;
+
+    while (bytes > 0) {
+        ssize_t got = read(fd, data, bytes);
+        if (got == 0) return 0;
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += got;
+        bytes -= got;
+    }
+    return 1;
+}
+
+// Size of a message on the wire, taken from its header and batch count
+static size_t message_size(const wire_msg_t *msg) {
+    switch (msg->header.type) {
+    case MSG_PULSE: return sizeof(pulse_msg_t);
+    case MSG_REPORT: return sizeof(report_msg_t);
+    case MSG_VOTE: return sizeof(vote_msg_t);
+    case MSG_DISMISS: return sizeof(dismiss_msg_t);
+    case MSG_DROPPED: return sizeof(dropped_msg_t);
+    case MSG_REPORT_BATCH: return report_batch_size(msg->report_batch.count);
+    case MSG_VOTE_BATCH: return vote_batch_size(msg->vote_batch.count);
+    default: return 0;
+    }
+}
+
+static int message_items(const wire_msg_t *msg) {
+    switch (msg->header.type) {
+    case MSG_REPORT_BATCH: return msg->report_batch.count;
+    case MSG_VOTE_BATCH: return msg->vote_batch.count;
+    default: return 1;
+    }
+}
+
+// The stream has no framing of its own, so read the header and then as much
+// of the payload as the type says. Returns the message size, 0 at end of
+// stream and -1 on a read error or malformed message
+static ssize_t read_message(int fd, wire_msg_t *msg) {
+    int status = read_full(fd, &msg->header, sizeof(msg->header));
+    if (status <= 0) return status;
+
+    if (msg->header.version != PROTOCOL_VERSION) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    char *payload = (char*) msg + sizeof(msg->header);
+
+    if (msg->header.type == MSG_REPORT_BATCH || msg->header.type == MSG_VOTE_BATCH) {
+        // Count and reserved field come first, then the entries in use
+        size_t prefix = offsetof(report_batch_msg_t, entries) - sizeof(msg->header);
+        if (read_full(fd, payload, prefix) != 1) return -1;
+
+        int limit = msg->header.type == MSG_REPORT_BATCH ? REPORT_BATCH_MAX : VOTE_BATCH_MAX;
+        if (msg->report_batch.count > limit) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        payload += prefix;
+    }
+
+    size_t size = message_size(msg);
+    if (size == 0) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    size_t remaining = size - (payload - (char*) msg);
+    if (remaining > 0 && read_full(fd, payload, remaining) != 1) return -1;
+
+    return size;
+}
+
+// Musician process side
+
+static int child_fd = -1;
+
+// Relays the reports the local executor sends to this process's channel
+static void* forward_reports(void *arg) {
+    orchestra_t *orchestra = (orchestra_t*) arg;
+    wire_msg_t msg;
+
+    while (true) {
+        int rcvid = MsgReceive(orchestra->conductor_chid, &msg, sizeof(msg), NULL);
+        if (rcvid == -1) {
+            // The channel is destroyed when the conductor hangs up
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (rcvid == 0) continue;
+
+        size_t size = message_size(&msg);
+        if (size == 0 || write_full(child_fd, &msg, size) == -1) {
+            MsgError(rcvid, EPIPE);
+            continue;
+        }
+        MsgReply(rcvid, EOK, NULL, 0);
+    }
+
+    return NULL;
+}
+
+static void run_musician_process(process_group_t *group) {
+    orchestra_t *orchestra = group->orchestra;
+    standing_t *standings = orchestra->standings;
+    child_fd = group->fd;
+
+    // Musicians of this process are stepped by a local executor as in --executor
+    executor_mode = true;
+
+    // The blacklist lives in the conductor process, which dismisses any
+    // musician it stops pulsing, even one restored blacklisted from a checkpoint
+    for (int i = 0; i < group->musician_count; i++) {
+        standings[group->first_musician + i].is_blacklisted = false;
+    }
+
+    // The conductor's channel stays behind in its process, reports go to a
+    // local one instead
+    orchestra->conductor_chid = ChannelCreate(0);
+    if (orchestra->conductor_chid == -1) {
+        perror("Musician process could not create channel");
+        _exit(1);
+    }
+    orchestra->coid_to_conductor = ConnectAttach(0, 0, orchestra->conductor_chid,
+                                                 _NTO_SIDE_CHANNEL, 0);
+    if (orchestra->coid_to_conductor == -1) {
+        perror("Musician process could not connect to its channel");
+        _exit(1);
+    }
+
+    int task_capacity = orchestra->num_musicians * MAX_PIPELINE_DEPTH;
+    if (initialize_timing_wheel(task_capacity) != 0 ||
+        initialize_executor(executor_workers > 0 ? executor_workers : 1, task_capacity) != 0 ||
+        executor_attach_orchestra(orchestra) != 0) {
+        _exit(1);
+    }
+
+    pthread_t forwarder;
+    if (start_thread(&forwarder, NULL, forward_reports, orchestra) != 0) {
+        perror("Could not create report forwarder");
+        _exit(1);
+    }
+
+    wire_msg_t msg;
+    ssize_t size;
+
+    while ((size = read_message(child_fd, &msg)) > 0) {
+        if (msg.header.type == MSG_PULSE) {
+            tempo_t tempo = {
+                .bpm = msg.pulse.conductor_bpm,
+                .epoch = msg.pulse.tempo_epoch,
+                .sequence = msg.header.sequence,
+                .set_ns = msg.pulse.tempo_set_ns
+            };
+
+            for (int i = 0; i < group->musician_count; i++) {
+                int musician_id = group->first_musician + i;
+                if (standings[musician_id].is_blacklisted ||
+                    executor_post_pulse(orchestra, musician_id, &tempo) == 0) {
+                    continue;
+                }
+
+                // The conductor counted the musician on the beat, through
+                // the forwarder so it is not written alongside its reports
+                dropped_msg_t dropped;
+                init_msg_header(&dropped.header, MSG_DROPPED, musician_id, msg.header.sequence);
+                send_message(orchestra->coid_to_conductor, &dropped.header, sizeof(dropped), 1);
+            }
+        } else if (msg.header.type == MSG_DISMISS &&
+                   msg.dismiss.musician_id < orchestra->num_musicians) {
+            standings[msg.dismiss.musician_id].is_blacklisted = true;
+        }
+    }
+
+    if (size == -1) {
+        printf("Musician process %d: Lost conductor: %s\n", group->id, strerror(errno));
+    }
+
+    // Conductor hung up, release anything blocked on the local channel
+    program_running = false;
+    ChannelDestroy(orchestra->conductor_chid);
+    shutdown_executor();
+    shutdown_timing_wheel();
+    join_thread(forwarder, "Report forwarder");
+
+    close(child_fd);
+    fflush(stdout);
+    _exit(0);
+}
+
+// Conductor process side
+
+static int send_to_group(process_group_t *group, msg_header_t *header, size_t bytes, int items) {
+    header->timestamp_ns = monotonic_time_ns();
+
+    if (write_full(group->fd, header, bytes) == -1) {
+        group->alive = false;
+        return -1;
+    }
+
+    record_wire_message(bytes, items);
+    return 0;
+}
+
+// A crashed process only takes its own musicians out of the concert
+static void dismiss_group(process_group_t *group) {
+    orchestra_t *orchestra = group->orchestra;
+    group->alive = false;
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+    for (int i = 0; i < group->musician_count; i++) {
+        standing_t *standing = &orchestra->standings[group->first_musician + i];
+        if (!standing->is_blacklisted) {
+            standing->is_blacklisted = true;
+            standing->blacklist_time = time(NULL);
+        }
+    }
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+
+    printf("*** Musician process %d (pid %d) exited, dismissing its %d musicians ***\n",
+           group->id, (int) group->pid, group->musician_count);
+}
+
+// Feeds one musician process's messages into the conductor channel
+static void* link_thread(void *arg) {
+    process_group_t *group = (process_group_t*) arg;
+    orchestra_t *orchestra = group->orchestra;
+
+    int coid = ConnectAttach(0, 0, orchestra->conductor_chid, _NTO_SIDE_CHANNEL, 0);
+    if (coid == -1) {
+        perror("Link could not create connection to conductor");
+        return NULL;
+    }
+
+    wire_msg_t msg;
+    ssize_t size;
+
+    while ((size = read_message(group->fd, &msg)) > 0) {
+        record_wire_message(size, message_items(&msg));
+
+        // The conductor process draws what its musician processes played
+        if (msg.header.type == MSG_REPORT_BATCH) {
+            for (int i = 0; i < msg.report_batch.count; i++) {
+                const report_entry_t *entry = &msg.report_batch.entries[i];
+                if (entry->musician_id >= orchestra->num_musicians) continue;
+
+                performance_t *performance = &orchestra->performances[entry->musician_id];
+                add_note_event(orchestra, performance->notes[performance->note_index], entry->reported_bpm,
+                               entry->musician_id);
+                performance->note_index = (performance->note_index + 1) % performance->note_count;
+            }
+        }
+
+        // Sent unchanged so the conductor sees the musician's own timestamp
+        if (MsgSend(coid, &msg, size, NULL, 0) == -1) {
+            break;
+        }
+        sample_thread_cpu(NULL);
+    }
+
+    if (program_running && orchestra->playing && group->alive) {
+        dismiss_group(group);
+    }
+
+    ConnectDetach(coid);
+    return NULL;
+}
+
+int launch_musician_processes(orchestra_t *orchestra, int requested_processes) {
+    int num_musicians = orchestra->num_musicians;
+    int processes = requested_processes;
+
+    // Default to one musician process per online CPU
+    if (processes <= 0) {
+        processes = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (processes > num_musicians) {
+        processes = num_musicians;
+    }
+    if (processes > MAX_PROCESSES) {
+        processes = MAX_PROCESSES;
+    }
+    if (processes < 1) {
+        processes = 1;
+    }
+
+    // A crashed musician process must not take the conductor down with EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    memset(dismissed, 0, sizeof(dismissed));
+
+    // Fork before the conductor process starts any threads, and with nothing
+    // buffered for the children to print again
+    fflush(stdout);
+
+    for (int g = 0; g < processes; g++) {
+        process_group_t *group = &groups[g];
+        int sockets[2];
+
+        group->id = g;
+        group->orchestra = orchestra;
+        group->first_musician = num_musicians * g / processes;
+        group->musician_count = num_musicians * (g + 1) / processes - group->first_musician;
+        group->link_started = false;
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
+            perror("Could not create musician process socket");
+            return -1;
+        }
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("Could not fork musician process");
+            close(sockets[0]);
+            close(sockets[1]);
+            return -1;
+        }
+
+        if (pid == 0) {
+            // Only keep this group's end of the socket
+            for (int i = 0; i < g; i++) {
+                close(groups[i].fd);
+            }
+            close(sockets[0]);
+            group->fd = sockets[1];
+            run_musician_process(group);
+        }
+
+        close(sockets[1]);
+        group->pid = pid;
+        group->fd = sockets[0];
+        group->alive = true;
+        group_count++;
+    }
+
+    for (int g = 0; g < group_count; g++) {
+        if (start_thread(&groups[g].link_thread, NULL, link_thread, &groups[g]) != 0) {
+            perror("Could not create musician process link");
+            return -1;
+        }
+        groups[g].link_started = true;
+    }
+
+    printf("Launched %d musician processes of up to %d musicians each\n",
+           group_count, (num_musicians + group_count - 1) / group_count);
+    return 0;
+}
+
+void shutdown_musician_processes() {
+    // Hanging up ends each musician process and unblocks its link
+    for (int g = 0; g < group_count; g++) {
+        shutdown(groups[g].fd, SHUT_RDWR);
+    }
+
+    for (int g = 0; g < group_count; g++) {
+        if (groups[g].link_started) {
+            join_thread(groups[g].link_thread, "Process link");
+        }
+        close(groups[g].fd);
+        waitpid(groups[g].pid, NULL, 0);
+    }
+
+    group_count = 0;
+}
+
+// One pulse per musician process, returns the number of musicians it reaches
+int process_post_pulse(orchestra_t *orchestra, pulse_msg_t *pulse) {
+    int active_musicians = 0;
+
+    for (int g = 0; g < group_count; g++) {
+        process_group_t *group = &groups[g];
+        int group_active = 0;
+        int group_probation = 0;
+
+        if (!group->alive) continue;
+
+        for (int i = 0; i < group->musician_count; i++) {
+            int musician_id = group->first_musician + i;
+
+            if (!orchestra->standings[musician_id].is_blacklisted) {
+                group_active++;
+            } else if (is_on_probation(orchestra, musician_id)) {
+                // Still pulsed, the beat just does not wait for it
+                mark_probation_pulse(orchestra, musician_id, pulse->header.sequence);
+                group_probation++;
+            } else if (!dismissed[musician_id]) {
+                dismiss_msg_t dismiss = { .musician_id = musician_id };
+                init_msg_header(&dismiss.header, MSG_DISMISS, PROTOCOL_CONDUCTOR_ID,
+                                pulse->header.sequence);
+                send_to_group(group, &dismiss.header, sizeof(dismiss), 1);
+                dismissed[musician_id] = true;
+            }
+        }
+
+        if (group_active + group_probation == 0) continue;
+
+        if (send_to_group(group, &pulse->header, sizeof(*pulse),
+                          group_active + group_probation) == 0) {
+            active_musicians += group_active;
+        } else {
+            printf("Conductor: Could not pulse musician process %d: %s\n",
+                   group->id, strerror(errno));
+        }
+    }
+
+    return active_musicians;
+}
@@ -0,0 +1,8 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+int launch_musician_processes(orchestra_t *orchestra, int requested_processes);
+void shutdown_musician_processes();
+int process_post_pulse(orchestra_t *orchestra, pulse_msg_t *pulse);
+
+#endif
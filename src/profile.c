@@ -0,0 +1,179 @@
+#include <byzantine_orchestra.h>
+
+// Each thread samples its own CPU clock and context switch counts, on every
+// pulse or unit of work, and adds what it used since its last sample to the
+// totals of its role and of the musician it was playing
+static cpu_usage_t role_totals[ROLE_COUNT];
+static int role_threads[ROLE_COUNT];
+
+static const char *role_names[ROLE_COUNT] = {
+    "conductor", "musicians", "workers", "timer", "visualizer", "audio", "services"
+};
+
+// The calling thread's role and usage at its last sample
+static __thread struct {
+    bool profiled;
+    thread_role_t role;
+    cpu_usage_t last;
+} self;
+
+static void read_thread_usage(cpu_usage_t *usage) {
+    struct timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    usage->cpu_ns = (uint64_t) cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+
+#ifdef RUSAGE_THREAD
+    struct rusage rusage;
+    if (getrusage(RUSAGE_THREAD, &rusage) == 0) {
+        usage->voluntary_switches = rusage.ru_nvcsw;
+        usage->involuntary_switches = rusage.ru_nivcsw;
+        return;
+    }
+#endif
+    // QNX keeps no per-thread counts, only the CPU time is sampled
+    usage->voluntary_switches = 0;
+    usage->involuntary_switches = 0;
+}
+
+bool context_switches_counted() {
+#ifdef RUSAGE_THREAD
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Called first thing by each thread. start_thread profiles every thread as
+// a service until it says otherwise, and what it used until then goes to
+// the role it takes
+void profile_thread(thread_role_t role) {
+    if (self.profiled) {
+        __atomic_sub_fetch(&role_threads[self.role], 1, __ATOMIC_RELAXED);
+    } else {
+        read_thread_usage(&self.last);
+        self.profiled = true;
+    }
+
+    self.role = role;
+    __atomic_add_fetch(&role_threads[role], 1, __ATOMIC_RELAXED);
+}
+
+// Usage since the last sample goes to the thread's role, and to the
+// musician's performance if one was being played. A worker's switches
+// between two steps count against the musician it stepped next
+void sample_thread_cpu(performance_t *performance) {
+    if (!self.profiled) return;
+
+    cpu_usage_t now;
+    read_thread_usage(&now);
+
+    uint64_t cpu_ns = now.cpu_ns - self.last.cpu_ns;
+    uint64_t voluntary = now.voluntary_switches - self.last.voluntary_switches;
+    uint64_t involuntary = now.involuntary_switches - self.last.involuntary_switches;
+    self.last = now;
+
+    cpu_usage_t *total = &role_totals[self.role];
+    __atomic_add_fetch(&total->cpu_ns, cpu_ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->voluntary_switches, voluntary, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->involuntary_switches, involuntary, __ATOMIC_RELAXED);
+
+    if (performance != NULL) {
+        __atomic_add_fetch(&performance->cpu.cpu_ns, cpu_ns, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&performance->cpu.voluntary_switches, voluntary, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&performance->cpu.involuntary_switches, involuntary, __ATOMIC_RELAXED);
+    }
+}
+
+// The last of the thread's usage, as it returns
+void finish_thread_profile() {
+    if (!self.profiled) return;
+
+    sample_thread_cpu(NULL);
+    __atomic_sub_fetch(&role_threads[self.role], 1, __ATOMIC_RELAXED);
+    self.profiled = false;
+}
+
+void role_cpu_usage(cpu_usage_t usage[ROLE_COUNT], int threads[ROLE_COUNT]) {
+    for (int r = 0; r < ROLE_COUNT; r++) {
+        usage[r].cpu_ns = __atomic_load_n(&role_totals[r].cpu_ns, __ATOMIC_RELAXED);
+        usage[r].voluntary_switches =
+            __atomic_load_n(&role_totals[r].voluntary_switches, __ATOMIC_RELAXED);
+        usage[r].involuntary_switches =
+            __atomic_load_n(&role_totals[r].involuntary_switches, __ATOMIC_RELAXED);
+        threads[r] = __atomic_load_n(&role_threads[r], __ATOMIC_RELAXED);
+    }
+}
+
+void musician_cpu_usage(const performance_t *performance, cpu_usage_t *usage) {
+    usage->cpu_ns = __atomic_load_n(&performance->cpu.cpu_ns, __ATOMIC_RELAXED);
+    usage->voluntary_switches =
+        __atomic_load_n(&performance->cpu.voluntary_switches, __ATOMIC_RELAXED);
+    usage->involuntary_switches =
+        __atomic_load_n(&performance->cpu.involuntary_switches, __ATOMIC_RELAXED);
+}
+
+const char* role_name(thread_role_t role) {
+    return role_names[role];
+}
+
+// Shares are of one core over the concert's wall time. Musician processes
+// keep their own totals, so only the conductor process is counted
+void print_profile_summary(const orchestra_t *orchestra, uint64_t wall_ns) {
+    cpu_usage_t usage[ROLE_COUNT];
+    int threads[ROLE_COUNT];
+    uint64_t total_ns = 0;
+    int cpu_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (wall_ns == 0) return;
+    role_cpu_usage(usage, threads);
+
+    printf("\nCPU by role over %.1f s\n", wall_ns / 1e9);
+    for (int r = 0; r < ROLE_COUNT; r++) {
+        if (usage[r].cpu_ns == 0 && threads[r] == 0) continue;
+
+        total_ns += usage[r].cpu_ns;
+        printf("%s: %.1f ms, %.2f%% of a core", role_names[r],
+               usage[r].cpu_ns / 1e6, 100.0 * usage[r].cpu_ns / wall_ns);
+        if (context_switches_counted()) {
+            printf(", %llu voluntary and %llu involuntary switches",
+                   (unsigned long long) usage[r].voluntary_switches,
+                   (unsigned long long) usage[r].involuntary_switches);
+        }
+        printf("\n");
+    }
+
+    struct timespec process_cpu;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &process_cpu);
+    uint64_t process_ns = (uint64_t) process_cpu.tv_sec * 1000000000ULL + process_cpu.tv_nsec;
+    printf("All threads: %.2f%% of a core, %.2f%% of %d CPUs (whole process %.1f ms)\n",
+           100.0 * total_ns / wall_ns, 100.0 * total_ns / wall_ns / (cpu_count > 0 ? cpu_count : 1),
+           cpu_count, process_ns / 1e6);
+
+    if (process_mode) return;
+
+    // The busiest musician of the first concert against the mean
+    uint64_t musician_total_ns = 0;
+    uint64_t switches_total = 0;
+    int busiest = 0;
+    uint64_t busiest_ns = 0;
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        cpu_usage_t musician;
+        musician_cpu_usage(&orchestra->performances[i], &musician);
+        musician_total_ns += musician.cpu_ns;
+        switches_total += musician.voluntary_switches + musician.involuntary_switches;
+        if (musician.cpu_ns > busiest_ns) {
+            busiest_ns = musician.cpu_ns;
+            busiest = i;
+        }
+    }
+
+    int pulses = orchestra->pulses_sent > 0 ? orchestra->pulses_sent : 1;
+    printf("Musician CPU: mean %.1f us per pulse, busiest %s %.1f us per pulse",
+           musician_total_ns / 1000.0 / orchestra->num_musicians / pulses,
+           orchestra->musicians[busiest].name, busiest_ns / 1000.0 / pulses);
+    if (context_switches_counted()) {
+        printf(", %.2f context switches per musician per pulse",
+               (double) switches_total / orchestra->num_musicians / pulses);
+    }
+    printf("\n");
+}
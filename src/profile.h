@@ -0,0 +1,24 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+typedef enum {
+    ROLE_CONDUCTOR,
+    ROLE_MUSICIAN,
+    ROLE_WORKER,
+    ROLE_TIMER,
+    ROLE_VISUALIZER,
+    ROLE_AUDIO,
+    ROLE_SERVICE, // Checkpoint writer, setlist preloader, process links
+    ROLE_COUNT
+} thread_role_t;
+
+void profile_thread(thread_role_t role);
+void sample_thread_cpu(performance_t *performance);
+void finish_thread_profile();
+bool context_switches_counted();
+void role_cpu_usage(cpu_usage_t usage[ROLE_COUNT], int threads[ROLE_COUNT]);
+void musician_cpu_usage(const performance_t *performance, cpu_usage_t *usage);
+const char* role_name(thread_role_t role);
+void print_profile_summary(const orchestra_t *orchestra, uint64_t wall_ns);
+
+#endif
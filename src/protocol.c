@@ -0,0 +1,29 @@
+#include <byzantine_orchestra.h>
+
+void init_msg_header(msg_header_t *header, msg_type_t type, int sender, int sequence) {
+    header->version = PROTOCOL_VERSION;
+    header->type = type;
+    header->sender = (uint16_t) sender;
+    header->sequence = (uint32_t) sequence;
+    header->timestamp_ns = 0;
+}
+
+size_t report_batch_size(int count) {
+    return offsetof(report_batch_msg_t, entries) + count * sizeof(report_entry_t);
+}
+
+size_t vote_batch_size(int count) {
+    return offsetof(vote_batch_msg_t, entries) + count * sizeof(vote_entry_t);
+}
+
+// Stamp the send time and send, items is how many pulses, reports or votes the message carries
+int send_message(int coid, msg_header_t *header, size_t bytes, int items) {
+    header->timestamp_ns = monotonic_time_ns();
+
+    if (MsgSend(coid, header, bytes, NULL, 0) == -1) {
+        return -1;
+    }
+
+    record_wire_message(bytes, items);
+    return 0;
+}
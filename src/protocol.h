@@ -0,0 +1,97 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#define PROTOCOL_VERSION 2
+#define PROTOCOL_CONDUCTOR_ID 0xFFFF
+#define REPORT_BATCH_MAX 256
+#define VOTE_BATCH_MAX 256
+// Size of the untagged pulse_msg_t every message used before version 1
+#define LEGACY_MESSAGE_BYTES 40
+
+typedef enum {
+    MSG_PULSE = 1,
+    MSG_REPORT = 2,
+    MSG_VOTE = 3,
+    MSG_REPORT_BATCH = 4,
+    MSG_VOTE_BATCH = 5,
+    MSG_DISMISS = 6,
+    MSG_DROPPED = 7
+} msg_type_t;
+
+// Fixed header at the start of every message
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint16_t sender; // Musician id, worker id for batches, or PROTOCOL_CONDUCTOR_ID
+    uint32_t sequence; // Pulse being sent or answered
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC when sent
+} msg_header_t;
+
+typedef struct {
+    msg_header_t header;
+    float conductor_bpm; // Tempo of this pulse, see tempo.h
+    uint32_t tempo_epoch;
+    uint64_t tempo_set_ns;
+} pulse_msg_t;
+
+typedef struct {
+    msg_header_t header;
+    float reported_bpm;
+    uint32_t reserved;
+} report_msg_t;
+
+typedef struct {
+    msg_header_t header;
+    uint16_t target_id;
+    uint8_t is_negative;
+    uint8_t reserved[5];
+} vote_msg_t;
+
+// Tells a musician process to stop pulsing a blacklisted musician
+typedef struct {
+    msg_header_t header;
+    uint16_t musician_id;
+    uint8_t reserved[6];
+} dismiss_msg_t;
+
+// Tells the conductor a musician process dropped the header's pulse for the
+// sender, whose slot was still busy with an earlier one
+typedef struct {
+    msg_header_t header;
+} dropped_msg_t;
+
+typedef struct {
+    uint32_t sequence;
+    uint16_t musician_id;
+    uint16_t reserved;
+    float reported_bpm;
+} report_entry_t;
+
+typedef struct {
+    uint16_t voter_id;
+    uint16_t target_id;
+    uint8_t is_negative;
+    uint8_t reserved[3];
+} vote_entry_t;
+
+// Batches are sent with only their first count entries
+typedef struct {
+    msg_header_t header;
+    uint16_t count;
+    uint16_t reserved;
+    report_entry_t entries[REPORT_BATCH_MAX];
+} report_batch_msg_t;
+
+typedef struct {
+    msg_header_t header;
+    uint16_t count;
+    uint16_t reserved;
+    vote_entry_t entries[VOTE_BATCH_MAX];
+} vote_batch_msg_t;
+
+void init_msg_header(msg_header_t *header, msg_type_t type, int sender, int sequence);
+size_t report_batch_size(int count);
+size_t vote_batch_size(int count);
+int send_message(int coid, msg_header_t *header, size_t bytes, int items);
+
+#endif
@@ -1,32 +1,61 @@
 #include <byzantine_orchestra.h>
 
-static reputation_vote_t vote_buffer[MAX_MUSICIANS * MAX_MUSICIANS];
-static int vote_count = 0;
-pthread_mutex_t reputation_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-void initialize_reputation_system() {
-    pthread_mutex_lock(&reputation_mutex);
-
-    for (int i = 0; i < num_musicians; i++) {
-        musicians[i].reputation = INITIAL_REPUTATION;
-        musicians[i].is_blacklisted = false;
-        musicians[i].last_reported_bpm = conductor_bpm;
-        musicians[i].blacklist_time = 0;
+// Reputation decays continuously, by REPUTATION_DECAY_RATE per
+// REPUTATION_DECAY_PERIOD_NS, and is applied whenever it is read or changed
+// instead of sweeping every musician each measure. Blacklisted musicians
+// keep the reputation they were blacklisted with
+static double decay_factor(const standing_t *standing, uint64_t now) {
+    if (standing->is_blacklisted || now <= standing->reputation_time_ns) {
+        return 1.0;
     }
 
-    vote_count = 0;
+    double periods = (double)(now - standing->reputation_time_ns) / REPUTATION_DECAY_PERIOD_NS;
+    return pow(REPUTATION_DECAY_RATE, periods);
+}
 
-    pthread_mutex_unlock(&reputation_mutex);
+double musician_reputation(const orchestra_t *orchestra, int musician_id) {
+    const standing_t *standing = &orchestra->standings[musician_id];
+    return standing->reputation * decay_factor(standing, monotonic_time_ns());
 }
 
-void cleanup_reputation_system() {
-    if (pthread_mutex_trylock(&reputation_mutex) == 0) {
-        pthread_mutex_unlock(&reputation_mutex);
+// Fold the decay up to now into the stored reputation before changing it,
+// called with reputation_mutex held
+static void settle_reputation(standing_t *standing, uint64_t now) {
+    standing->reputation *= decay_factor(standing, now);
+    standing->reputation_time_ns = now;
+}
+
+void initialize_reputation_system(orchestra_t *orchestra) {
+    standing_t *standings = orchestra->standings;
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+
+    uint64_t now = monotonic_time_ns();
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        standings[i].reputation = INITIAL_REPUTATION;
+        standings[i].reputation_time_ns = now;
+        standings[i].is_blacklisted = false;
+        standings[i].last_reported_bpm = orchestra->conductor_bpm;
+        standings[i].blacklist_time = 0;
+        standings[i].probation_since = -1;
+        standings[i].probation_good_pulses = 0;
+        standings[i].reinstated_from = 0;
+        standings[i].reinstatements = 0;
+        standings[i].last_report_sequence = -1;
+        standings[i].reported_pulses = 0;
+        standings[i].detected_at = -1;
+        reset_change_detector(&standings[i].detector);
+        standings[i].detector_alarmed = false;
     }
 
-    usleep(10000);
+    orchestra->vote_count = 0;
+
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+}
 
-    pthread_mutex_destroy(&reputation_mutex);
+// Called once every thread that could hold reputation_mutex has been joined
+void cleanup_reputation_system(orchestra_t *orchestra) {
+    pthread_mutex_destroy(&orchestra->reputation_mutex);
 }
 
 double calculate_behaviour_score(double reported_bpm, double expected_bpm) {
@@ -41,78 +70,180 @@ double calculate_behaviour_score(double reported_bpm, double expected_bpm) {
     }
 }
 
-void update_reputation(int musician_id, double behaviour_score) {
-    if (musician_id < 0 || musician_id >= num_musicians) return;
+// GCC vector extensions, two doubles to fit the SSE2 or NEON registers
+// every QNX target has
+#define SCORE_LANES 2
+typedef double score_vec_t __attribute__((vector_size(SCORE_LANES * sizeof(double))));
+typedef int64_t score_mask_t __attribute__((vector_size(SCORE_LANES * sizeof(int64_t))));
+
+static score_vec_t select_scores(score_mask_t mask, score_vec_t if_set, score_vec_t if_clear) {
+    return (score_vec_t)((mask & (score_mask_t)if_set) | (~mask & (score_mask_t)if_clear));
+}
+
+// Branchless calculate_behaviour_score over whole arrays, giving bit for bit
+// the same scores, with the lanes left over at the end done by the scalar one.
+// Also gives each report's signed deviation, for the change detector
+void score_behaviours(const double *reported_bpm, const double *expected_bpm,
+                      double *scores, double *deviations, int count) {
+    const score_mask_t sign_bit = (score_mask_t){0} + INT64_MIN;
+    const score_vec_t reward = (score_vec_t){0} + GOOD_BEHAVIOR_REWARD;
+    const score_vec_t extreme = (score_vec_t){0} - EXTREME_BEHAVIOR_PENALTY;
+    const score_vec_t tolerance = (score_vec_t){0} + BPM_TOLERANCE;
+    const score_vec_t max_deviation = (score_vec_t){0} + BYZANTINE_MAX_DEVIATION;
+    int i = 0;
+
+    for (; i + SCORE_LANES <= count; i += SCORE_LANES) {
+        score_vec_t reported, expected;
+        memcpy(&reported, &reported_bpm[i], sizeof(reported));
+        memcpy(&expected, &expected_bpm[i], sizeof(expected));
+
+        score_vec_t signed_deviation = (reported - expected) / expected;
+        score_vec_t difference = (score_vec_t)((score_mask_t)(reported - expected) & ~sign_bit);
+        score_vec_t deviation = difference / expected;
+        score_vec_t scaled = -BAD_BEHAVIOR_PENALTY * (deviation / max_deviation);
+
+        score_vec_t score = select_scores(deviation <= max_deviation, scaled, extreme);
+        score = select_scores(deviation <= tolerance, reward, score);
+        memcpy(&scores[i], &score, sizeof(score));
+        memcpy(&deviations[i], &signed_deviation, sizeof(signed_deviation));
+    }
+
+    for (; i < count; i++) {
+        scores[i] = calculate_behaviour_score(reported_bpm[i], expected_bpm[i]);
+        deviations[i] = (reported_bpm[i] - expected_bpm[i]) / expected_bpm[i];
+    }
+}
+
+// Apply a batch of scores, scaled by weight, and feed the deviations to the
+// change detector, under a single lock. Kept scalar since a batch can hold
+// several reports from the same musician
+void apply_behaviour_scores(orchestra_t *orchestra, const int *musician_ids,
+                            const double *scores, const double *deviations,
+                            double weight, int count) {
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+
+    uint64_t now = monotonic_time_ns();
+    for (int i = 0; i < count; i++) {
+        int musician_id = musician_ids[i];
+        if (musician_id < 0 || musician_id >= orchestra->num_musicians) continue;
+
+        standing_t *standing = &orchestra->standings[musician_id];
+
+        // Blacklisted by an earlier report in the batch, so skipped as the
+        // conductor skips any report of a blacklisted musician it receives
+        if (standing->is_blacklisted) continue;
+
+        settle_reputation(standing, now);
+        standing->reputation = fmin(fmax(standing->reputation + scores[i] * weight,
+                                         MIN_REPUTATION), MAX_REPUTATION);
+
+        // Settled, so the stored reputation is the current one
+        double threshold = orchestra->musicians[musician_id].is_first_chair ?
+                           FIRST_CHAIR_THRESHOLD : BLACKLIST_THRESHOLD;
+        if (standing->reputation <= threshold) {
+            blacklist_musician(orchestra, musician_id);
+        }
+
+        // Unless this report's score has just blacklisted it
+        if (detector_mode == DETECTOR_CUSUM && !standing->is_blacklisted &&
+            observe_deviation(&standing->detector, deviations[i])) {
+            // Credited with the catch unless reputation caught it first
+            if (standing->detected_at < 0) {
+                standing->detector_alarmed = true;
+            }
+            count_event(COUNTER_CHANGES_DETECTED);
+            if (orchestra->verbose && !is_large_orchestra(orchestra)) {
+                printf("Conductor: Change detected in %s's tempo by pulse %d\n",
+                       orchestra->musicians[musician_id].name, orchestra->pulses_sent);
+            }
+            blacklist_musician(orchestra, musician_id);
+        }
+    }
+
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+}
+
+void update_reputation(orchestra_t *orchestra, int musician_id, double behaviour_score) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return;
 
-    pthread_mutex_lock(&reputation_mutex);
+    pthread_mutex_lock(&orchestra->reputation_mutex);
 
-    musician_t *musician = &musicians[musician_id];
+    standing_t *standing = &orchestra->standings[musician_id];
 
-    musician->reputation += behaviour_score;
+    settle_reputation(standing, monotonic_time_ns());
+    standing->reputation += behaviour_score;
 
-    if (musician->reputation > MAX_REPUTATION) {
-        musician->reputation = MAX_REPUTATION;
-    } else if (musician->reputation < MIN_REPUTATION) {
-        musician->reputation = MIN_REPUTATION;
+    if (standing->reputation > MAX_REPUTATION) {
+        standing->reputation = MAX_REPUTATION;
+    } else if (standing->reputation < MIN_REPUTATION) {
+        standing->reputation = MIN_REPUTATION;
     }
 
     // Check for blacklisting
-    if (should_blacklist_musician(musician_id) && !musician->is_blacklisted) {
-        blacklist_musician(musician_id);
+    if (should_blacklist_musician(orchestra, musician_id) && !standing->is_blacklisted) {
+        blacklist_musician(orchestra, musician_id);
     }
 
-    pthread_mutex_unlock(&reputation_mutex);
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
 }
 
-void cast_reputation_vote(int voter_id, int target_id, bool is_negative) {
-    if (voter_id < 0 || voter_id >= num_musicians ||
-        target_id < 0 || target_id >= num_musicians ||
-        voter_id == target_id || musicians[voter_id].is_blacklisted) {
+void cast_reputation_vote(orchestra_t *orchestra, int voter_id, int target_id, bool is_negative) {
+    if (voter_id < 0 || voter_id >= orchestra->num_musicians ||
+        target_id < 0 || target_id >= orchestra->num_musicians ||
+        voter_id == target_id || orchestra->standings[voter_id].is_blacklisted) {
         return;
     }
 
-    pthread_mutex_lock(&reputation_mutex);
+    pthread_mutex_lock(&orchestra->reputation_mutex);
 
-    if (vote_count < MAX_MUSICIANS * MAX_MUSICIANS) {
-        vote_buffer[vote_count].voter_id = voter_id;
-        vote_buffer[vote_count].target_id = target_id;
-        vote_buffer[vote_count].is_negative = is_negative;
-        vote_buffer[vote_count].timestamp = time(NULL);
-        vote_count++;
+    if (orchestra->vote_count < orchestra->vote_capacity) {
+        reputation_vote_t *vote = &orchestra->vote_buffer[orchestra->vote_count++];
+        vote->voter_id = voter_id;
+        vote->target_id = target_id;
+        vote->is_negative = is_negative;
+        vote->timestamp = time(NULL);
+    } else {
+        count_event(COUNTER_VOTES_DROPPED);
     }
 
-    pthread_mutex_unlock(&reputation_mutex);
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
 }
 
-void process_reputation_votes() {
-    if (vote_count == 0) return;
+void process_reputation_votes(orchestra_t *orchestra) {
+    if (orchestra->vote_count == 0) return;
 
-    pthread_mutex_lock(&reputation_mutex);
+    pthread_mutex_lock(&orchestra->reputation_mutex);
 
-    int negative_votes[MAX_MUSICIANS] = {0};
-    int positive_votes[MAX_MUSICIANS] = {0};
+    const musician_t *musicians = orchestra->musicians;
+    standing_t *standings = orchestra->standings;
+    const reputation_vote_t *vote_buffer = orchestra->vote_buffer;
+    int num_musicians = orchestra->num_musicians;
+    int *negative_votes = orchestra->vote_tally;
+    int *positive_votes = orchestra->vote_tally + num_musicians;
     int total_voters = 0;
 
+    memset(orchestra->vote_tally, 0, sizeof(int) * 2 * num_musicians);
+
     // Count non-blacklisted voters
     for (int i = 0; i < num_musicians; i++) {
-        if (!musicians[i].is_blacklisted) {
+        if (!standings[i].is_blacklisted) {
             total_voters++;
         }
     }
 
     if (total_voters == 0) {
-        vote_count = 0;
-        pthread_mutex_unlock(&reputation_mutex);
+        orchestra->vote_count = 0;
+        pthread_mutex_unlock(&orchestra->reputation_mutex);
         return;
     }
 
     // Process votes
-    for (int i = 0; i < vote_count; i++) {
+    for (int i = 0; i < orchestra->vote_count; i++) {
         int voter = vote_buffer[i].voter_id;
         int target = vote_buffer[i].target_id;
 
         // Only count votes from non-blacklisted musicians
-        if (!musicians[voter].is_blacklisted) {
+        if (!standings[voter].is_blacklisted) {
             if (vote_buffer[i].is_negative) {
                 negative_votes[target]++;
             } else {
@@ -123,92 +254,222 @@ void process_reputation_votes() {
 
     // Apply reputation changes based on consensus
     for (int i = 0; i < num_musicians; i++) {
-        if (musicians[i].is_blacklisted) continue;
+        if (standings[i].is_blacklisted) continue;
 
         double negative_ratio = (double)negative_votes[i] / total_voters;
         double positive_ratio = (double)positive_votes[i] / total_voters;
 
+        if (negative_ratio < CONSENSUS_THRESHOLD && positive_ratio < CONSENSUS_THRESHOLD) {
+            continue;
+        }
+
+        settle_reputation(&standings[i], monotonic_time_ns());
+
         if (negative_ratio >= CONSENSUS_THRESHOLD) {
-            musicians[i].reputation -= BAD_BEHAVIOR_PENALTY;
-            printf("Consensus negative vote against %s (%.1f%% voted negative)\n",
-                   musicians[i].name, negative_ratio * 100);
+            standings[i].reputation -= BAD_BEHAVIOR_PENALTY;
+            if (orchestra->verbose) {
+                printf("Consensus negative vote against %s (%.1f%% voted negative)\n",
+                       musicians[i].name, negative_ratio * 100);
+            }
         } else if (positive_ratio >= CONSENSUS_THRESHOLD) {
-            musicians[i].reputation += GOOD_BEHAVIOR_REWARD;
+            standings[i].reputation += GOOD_BEHAVIOR_REWARD;
         }
 
-        if (musicians[i].reputation > MAX_REPUTATION) {
-            musicians[i].reputation = MAX_REPUTATION;
-        } else if (musicians[i].reputation < MIN_REPUTATION) {
-            musicians[i].reputation = MIN_REPUTATION;
+        if (standings[i].reputation > MAX_REPUTATION) {
+            standings[i].reputation = MAX_REPUTATION;
+        } else if (standings[i].reputation < MIN_REPUTATION) {
+            standings[i].reputation = MIN_REPUTATION;
         }
 
         // Check for blacklisting
-        if (should_blacklist_musician(i) && !musicians[i].is_blacklisted) {
-            blacklist_musician(i);
+        if (should_blacklist_musician(orchestra, i) && !standings[i].is_blacklisted) {
+            blacklist_musician(orchestra, i);
         }
     }
 
-    vote_count = 0;
+    orchestra->vote_count = 0;
 
-    pthread_mutex_unlock(&reputation_mutex);
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
 }
 
-bool should_blacklist_musician(int musician_id) {
-    if (musician_id < 0 || musician_id >= num_musicians) return false;
+bool should_blacklist_musician(const orchestra_t *orchestra, int musician_id) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return false;
 
-    musician_t *musician = &musicians[musician_id];
+    const musician_t *musician = &orchestra->musicians[musician_id];
 
     // First chair musicians have a lower threshold
     double threshold = musician->is_first_chair ? FIRST_CHAIR_THRESHOLD : BLACKLIST_THRESHOLD;
 
-    return musician->reputation <= threshold;
+    return musician_reputation(orchestra, musician_id) <= threshold;
 }
 
-void blacklist_musician(int musician_id) {
-    if (musician_id < 0 || musician_id >= num_musicians) return;
+void blacklist_musician(orchestra_t *orchestra, int musician_id) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return;
+
+    const musician_t *musician = &orchestra->musicians[musician_id];
+    standing_t *standing = &orchestra->standings[musician_id];
 
-    musician_t *musician = &musicians[musician_id];
+    if (!standing->is_blacklisted) {
+        settle_reputation(standing, monotonic_time_ns());
+        standing->is_blacklisted = true;
+        standing->blacklist_time = time(NULL);
+        if (standing->detected_at < 0) {
+            standing->detected_at = orchestra->pulses_sent;
+        }
+        standing->probation_since = -1;
+        standing->probation_good_pulses = 0;
 
-    if (!musician->is_blacklisted) {
-        musician->is_blacklisted = true;
-        musician->blacklist_time = time(NULL);
+        count_event(COUNTER_BLACKLISTED);
+        if (standing->reinstatements > 0) {
+            count_event(COUNTER_REBLACKLISTED);
+        }
 
-        const char *status = musician->is_first_chair ? "[FIRST CHAIR]" : "";
-        printf("*** %s %s has been BLACKLISTED (reputation: %.1f) ***\n",
-               musician->name, status, musician->reputation);
+        if (orchestra->verbose) {
+            const char *status = musician->is_first_chair ? "[FIRST CHAIR]" : "";
+            printf("*** %s %s has been BLACKLISTED (reputation: %.1f) ***\n",
+                   musician->name, status, standing->reputation);
+        }
     }
 }
 
-void decay_all_reputations() {
-    pthread_mutex_lock(&reputation_mutex);
+// Blacklisted musicians keep getting pulses and are scored in shadow
+bool is_on_probation(const orchestra_t *orchestra, int musician_id) {
+    return probation_streak > 0 && orchestra->standings[musician_id].is_blacklisted;
+}
 
-    for (int i = 0; i < num_musicians; i++) {
-        if (!musicians[i].is_blacklisted) {
-            musicians[i].reputation *= REPUTATION_DECAY_RATE;
+// Called as a probation pulse goes out, reports for earlier pulses were
+// already expected by their beats
+void mark_probation_pulse(orchestra_t *orchestra, int musician_id, int sequence) {
+    standing_t *standing = &orchestra->standings[musician_id];
+
+    if (standing->probation_since < 0) {
+        standing->probation_since = sequence;
+    }
+}
+
+// Score a probation report without touching reputation or tempo, a musician
+// reinstated here counts again from next_sequence on
+void shadow_score_musician(orchestra_t *orchestra, int musician_id,
+                           double behaviour_score, int next_sequence) {
+    if (!is_on_probation(orchestra, musician_id)) return;
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+
+    standing_t *standing = &orchestra->standings[musician_id];
+
+    if (behaviour_score <= 0) {
+        standing->probation_good_pulses = 0;
+    } else if (++standing->probation_good_pulses >= probation_streak) {
+        standing->is_blacklisted = false;
+        standing->reputation = REINSTATED_REPUTATION;
+        standing->reputation_time_ns = monotonic_time_ns();
+        standing->probation_since = -1;
+        standing->probation_good_pulses = 0;
+        standing->reinstated_from = next_sequence;
+        standing->reinstatements++;
+        // Watched afresh, so it is caught as quickly if it misbehaves again
+        reset_change_detector(&standing->detector);
+
+        count_event(COUNTER_REINSTATED);
+        if (orchestra->verbose && !is_large_orchestra(orchestra)) {
+            printf("*** %s has been REINSTATED after %d good pulses on probation (reputation: %.1f) ***\n",
+                   orchestra->musicians[musician_id].name, probation_streak, standing->reputation);
+        }
+    }
 
-            if (musicians[i].reputation < MIN_REPUTATION) {
-                musicians[i].reputation = MIN_REPUTATION;
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
+}
+
+bool is_musician_trusted(const orchestra_t *orchestra, int musician_id) {
+    if (musician_id < 0 || musician_id >= orchestra->num_musicians) return false;
+
+    return !orchestra->standings[musician_id].is_blacklisted &&
+           musician_reputation(orchestra, musician_id) >= BLACKLIST_THRESHOLD;
+}
+
+static void print_reputation_summary(const orchestra_t *orchestra) {
+    const musician_t *musicians = orchestra->musicians;
+    const standing_t *standings = orchestra->standings;
+    int num_musicians = orchestra->num_musicians;
+    int blacklisted = 0;
+    int byzantine_blacklisted = 0;
+    double reputation_sum = 0;
+
+    for (int i = 0; i < num_musicians; i++) {
+        if (standings[i].is_blacklisted) {
+            blacklisted++;
+            if (musicians[i].is_byzantine) {
+                byzantine_blacklisted++;
             }
+        } else {
+            reputation_sum += musician_reputation(orchestra, i);
         }
     }
 
-    pthread_mutex_unlock(&reputation_mutex);
+    int active = num_musicians - blacklisted;
+    printf("\nReputation Status (%d musicians)\n", num_musicians);
+    printf("Active: %d, blacklisted: %d (%d of %d byzantine caught), mean active reputation: %.1f\n",
+           active, blacklisted, byzantine_blacklisted, orchestra->byzantine_count,
+           active > 0 ? reputation_sum / active : 0.0);
 }
 
-bool is_musician_trusted(int musician_id) {
-    if (musician_id < 0 || musician_id >= num_musicians) return false;
+// Byzantine musicians are misbehaving from the first pulse, so the pulse
+// one is caught by is how long the detector took, and every honest one it
+// catches is a false alarm
+void print_detector_summary(orchestra_t *orchestra) {
+    if (detector_mode != DETECTOR_CUSUM) return;
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
 
-    return !musicians[musician_id].is_blacklisted &&
-           musicians[musician_id].reputation >= BLACKLIST_THRESHOLD;
+    int alarms[2] = {0, 0};
+    int delay_total = 0;
+    int delay_max = 0;
+    uint64_t honest_pulses = 0;
+
+    for (int i = 0; i < orchestra->num_musicians; i++) {
+        const standing_t *standing = &orchestra->standings[i];
+        bool byzantine = orchestra->musicians[i].is_byzantine;
+
+        if (!byzantine) {
+            honest_pulses += orchestra->pulses_sent;
+        }
+        if (!standing->detector_alarmed) continue;
+
+        alarms[byzantine]++;
+        if (byzantine) {
+            delay_total += standing->detected_at;
+            if (standing->detected_at > delay_max) {
+                delay_max = standing->detected_at;
+            }
+        }
+    }
+
+    printf("Change detector: %d of %d byzantine caught", alarms[1], orchestra->byzantine_count);
+    if (alarms[1] > 0) {
+        printf(" by mean pulse %.1f, max %d", (double) delay_total / alarms[1], delay_max);
+    }
+    printf(", %d false alarms in %llu honest musician pulses\n",
+           alarms[0], (unsigned long long) honest_pulses);
+
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
 }
 
-void print_reputation_status() {
-    pthread_mutex_lock(&reputation_mutex);
+void print_reputation_status(orchestra_t *orchestra) {
+    const musician_t *musicians = orchestra->musicians;
+    const standing_t *standings = orchestra->standings;
+
+    pthread_mutex_lock(&orchestra->reputation_mutex);
+
+    if (is_large_orchestra(orchestra)) {
+        print_reputation_summary(orchestra);
+        pthread_mutex_unlock(&orchestra->reputation_mutex);
+        return;
+    }
 
     printf("\nReputation Status\n");
-    for (int i = 0; i < num_musicians; i++) {
+    for (int i = 0; i < orchestra->num_musicians; i++) {
         const char *status = "";
-        if (musicians[i].is_blacklisted) {
+        if (standings[i].is_blacklisted) {
             status = "[BLACKLISTED]";
         } else if (musicians[i].is_first_chair) {
             status = "[FIRST CHAIR]";
@@ -216,9 +477,14 @@ void print_reputation_status() {
             status = "[BYZANTINE]";
         }
 
-        printf("%s %s: %.1f reputation\n",
-               musicians[i].name, status, musicians[i].reputation);
+        printf("%s %s: %.1f reputation", musicians[i].name, status,
+               musician_reputation(orchestra, i));
+        if (detector_mode == DETECTOR_CUSUM && !standings[i].is_blacklisted) {
+            printf(", change detector at %.0f%% of threshold",
+                   change_statistic(&standings[i].detector) * 100.0);
+        }
+        printf("\n");
     }
 
-    pthread_mutex_unlock(&reputation_mutex);
+    pthread_mutex_unlock(&orchestra->reputation_mutex);
 }
@@ -1,16 +1,26 @@
 #ifndef REPUTATION_H
 #define REPUTATION_H
 
-void initialize_reputation_system();
-void cleanup_reputation_system();
-void update_reputation(int musician_id, double behaviour_score);
-void process_reputation_votes();
-void cast_reputation_vote(int voter_id, int target_id, bool is_negative);
-bool should_blacklist_musician(int musician_id);
-void blacklist_musician(int musician_id);
+void initialize_reputation_system(orchestra_t *orchestra);
+void cleanup_reputation_system(orchestra_t *orchestra);
+void update_reputation(orchestra_t *orchestra, int musician_id, double behaviour_score);
+double musician_reputation(const orchestra_t *orchestra, int musician_id);
+void process_reputation_votes(orchestra_t *orchestra);
+void cast_reputation_vote(orchestra_t *orchestra, int voter_id, int target_id, bool is_negative);
+bool should_blacklist_musician(const orchestra_t *orchestra, int musician_id);
+void blacklist_musician(orchestra_t *orchestra, int musician_id);
 double calculate_behaviour_score(double reported_bpm, double expected_bpm);
-void decay_all_reputations();
-bool is_musician_trusted(int musician_id);
-void print_reputation_status();
+void score_behaviours(const double *reported_bpm, const double *expected_bpm,
+                      double *scores, double *deviations, int count);
+void apply_behaviour_scores(orchestra_t *orchestra, const int *musician_ids,
+                            const double *scores, const double *deviations,
+                            double weight, int count);
+bool is_musician_trusted(const orchestra_t *orchestra, int musician_id);
+bool is_on_probation(const orchestra_t *orchestra, int musician_id);
+void mark_probation_pulse(orchestra_t *orchestra, int musician_id, int sequence);
+void shadow_score_musician(orchestra_t *orchestra, int musician_id,
+                           double behaviour_score, int next_sequence);
+void print_reputation_status(orchestra_t *orchestra);
+void print_detector_summary(orchestra_t *orchestra);
 
 #endif
@@ -0,0 +1,352 @@
+#include <byzantine_orchestra.h>
+
+// The pieces a run plays in turn, MAX_PULSES pulses each, without stopping
+// the orchestra in between. The first is read before the concert starts,
+// and a preloader thread reads each of the others into a free slot while
+// the piece before it plays. Piece p of the setlist starts on pulse
+// p * MAX_PULSES, so a musician knows which piece a pulse belongs to from
+// its sequence number alone
+
+typedef struct {
+    const char *notes[MAX_MUSICIANS][MAX_NOTES];
+    int parts; // 0 if the score could not be read
+    int piece; // Staged in this slot, or -1
+    uint64_t staged_ns;
+} staged_score_t;
+
+static struct {
+    char *paths[MAX_SETLIST];
+    int length;
+    staged_score_t slots[SETLIST_SLOTS];
+    int staged; // Pieces read so far, in order
+    orchestra_t *orchestras;
+    int count;
+    bool started;
+    bool stopping;
+    pthread_t preloader;
+    bool preloading;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    // What the switches cost
+    int switches;
+    int waits; // Conductor pulses held up until their piece was staged
+    uint64_t wait_ns_max;
+    double lead_ms_total;
+    double lead_ms_min;
+    double read_ms_total;
+    int reads;
+    latency_stat_t switch_drift;
+} setlist = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// A Standard MIDI File or the one line per part text format
+static int read_score(const char *filename, staged_score_t *score) {
+    uint64_t start_ns = monotonic_time_ns();
+
+    if (is_midi_file(filename)) {
+        score->parts = read_midi_score(filename, score->notes);
+    } else {
+        score->parts = read_notes_from_file(filename, musician_names, score->notes);
+    }
+    if (score->parts <= 0) {
+        printf("Could not read notes from %s\n", filename);
+        score->parts = 0;
+        return -1;
+    }
+
+    // Read by the summary while the preloader may still be staging
+    pthread_mutex_lock(&setlist.lock);
+    setlist.read_ms_total += (monotonic_time_ns() - start_ns) / 1e6;
+    setlist.reads++;
+    pthread_mutex_unlock(&setlist.lock);
+    return 0;
+}
+
+static int stage_first_piece() {
+    for (int s = 0; s < SETLIST_SLOTS; s++) {
+        setlist.slots[s].piece = -1;
+    }
+    if (read_score(setlist.paths[0], &setlist.slots[0]) != 0) {
+        return -1;
+    }
+
+    setlist.slots[0].piece = 0;
+    setlist.slots[0].staged_ns = monotonic_time_ns();
+    setlist.staged = 1;
+    return 0;
+}
+
+// A setlist of one piece
+int load_score(const char *filename) {
+    setlist.paths[0] = strdup(filename);
+    if (setlist.paths[0] == NULL) {
+        perror("Could not allocate setlist");
+        return -1;
+    }
+    setlist.length = 1;
+    return stage_first_piece();
+}
+
+// One score path per line, blank lines and lines starting with # skipped.
+// Only the first piece is read before the concert starts
+int load_setlist(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    char line[1024];
+
+    if (file == NULL) {
+        perror("Could not open setlist");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        char *path = line;
+        while (isspace((unsigned char) *path)) {
+            path++;
+        }
+
+        int end = strlen(path) - 1;
+        while (end >= 0 && isspace((unsigned char) path[end])) {
+            path[end--] = '\0';
+        }
+        if (*path == '\0' || *path == '#') continue;
+
+        if (setlist.length == MAX_SETLIST) {
+            printf("Setlist %s has more than %d pieces, the rest are left out\n",
+                   filename, MAX_SETLIST);
+            break;
+        }
+        // A missing piece is found now rather than when it is due
+        if (access(path, R_OK) != 0) {
+            printf("Setlist piece %s: %s\n", path, strerror(errno));
+            fclose(file);
+            return -1;
+        }
+
+        setlist.paths[setlist.length] = strdup(path);
+        if (setlist.paths[setlist.length] == NULL) {
+            perror("Could not allocate setlist");
+            fclose(file);
+            return -1;
+        }
+        setlist.length++;
+    }
+    fclose(file);
+
+    if (setlist.length == 0) {
+        printf("Setlist %s has no pieces\n", filename);
+        return -1;
+    }
+    printf("Setlist of %d pieces from %s\n", setlist.length, filename);
+    return stage_first_piece();
+}
+
+// Lowest piece any concert has begun, called with the lock held
+static int slowest_piece() {
+    int slowest = INT_MAX;
+
+    for (int c = 0; c < setlist.count; c++) {
+        if (setlist.orchestras[c].piece < slowest) {
+            slowest = setlist.orchestras[c].piece;
+        }
+    }
+    return slowest;
+}
+
+// Piece p goes in the slot of piece p - SETLIST_SLOTS, which every concert
+// finished at least a whole piece ago once they have all begun piece p - 1
+static void* preload_setlist(void *arg) {
+    for (int piece = 1; piece < setlist.length; piece++) {
+        pthread_mutex_lock(&setlist.lock);
+        while (!setlist.stopping && slowest_piece() < piece - 1) {
+            pthread_cond_wait(&setlist.changed, &setlist.lock);
+        }
+        bool stopping = setlist.stopping;
+        pthread_mutex_unlock(&setlist.lock);
+        if (stopping) break;
+
+        staged_score_t *slot = &setlist.slots[piece % SETLIST_SLOTS];
+        free_notes_memory(slot->notes);
+        read_score(setlist.paths[piece], slot);
+        sample_thread_cpu(NULL);
+
+        pthread_mutex_lock(&setlist.lock);
+        slot->piece = piece;
+        slot->staged_ns = monotonic_time_ns();
+        setlist.staged = piece + 1;
+        pthread_cond_broadcast(&setlist.changed);
+        pthread_mutex_unlock(&setlist.lock);
+    }
+
+    return NULL;
+}
+
+int start_setlist(orchestra_t *orchestras, int count) {
+    setlist.orchestras = orchestras;
+    setlist.count = count;
+    setlist.stopping = false;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    int result = pthread_cond_init(&setlist.changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    if (result != 0) {
+        printf("Could not create setlist condition: %s\n", strerror(result));
+        return -1;
+    }
+    setlist.started = true;
+
+    if (setlist.length < 2) return 0;
+
+    if (start_thread(&setlist.preloader, NULL, preload_setlist, NULL) != 0) {
+        perror("Could not create setlist preloader");
+        return -1;
+    }
+    setlist.preloading = true;
+    return 0;
+}
+
+void stop_setlist() {
+    if (setlist.preloading) {
+        pthread_mutex_lock(&setlist.lock);
+        setlist.stopping = true;
+        pthread_cond_broadcast(&setlist.changed);
+        pthread_mutex_unlock(&setlist.lock);
+
+        join_thread(setlist.preloader, "Setlist preloader");
+        setlist.preloading = false;
+    }
+    if (setlist.started) {
+        pthread_cond_destroy(&setlist.changed);
+        setlist.started = false;
+    }
+
+    for (int s = 0; s < SETLIST_SLOTS; s++) {
+        free_notes_memory(setlist.slots[s].notes);
+        setlist.slots[s].piece = -1;
+    }
+    for (int i = 0; i < setlist.length; i++) {
+        free(setlist.paths[i]);
+        setlist.paths[i] = NULL;
+    }
+    setlist.length = 0;
+}
+
+// How long a concert plays
+int setlist_pulses() {
+    return MAX_PULSES * setlist.length;
+}
+
+// Extra musicians double the parts of the score, like orchestra sections
+void assign_part(performance_t *performance, int musician_id, int piece) {
+    staged_score_t *score = &setlist.slots[piece % SETLIST_SLOTS];
+    int part = musician_id % score->parts;
+    int note_count = 0;
+
+    while (note_count < MAX_NOTES && score->notes[part][note_count] != NULL) {
+        note_count++;
+    }
+
+    performance->notes = score->notes[part];
+    performance->note_count = note_count > 0 ? note_count : 1;
+}
+
+// Called by the conductor before the first pulse of each piece after the
+// first. Returns -1 if the piece could not be read or the run is stopping
+int begin_piece(orchestra_t *orchestra, int piece) {
+    uint64_t start_ns = monotonic_time_ns();
+    bool waited = false;
+
+    pthread_mutex_lock(&setlist.lock);
+    orchestra->piece = piece;
+    pthread_cond_broadcast(&setlist.changed);
+
+    // Normally staged long ago, a slow read holds up the pulse
+    while (program_running && setlist.staged <= piece) {
+        uint64_t until_ns = monotonic_time_ns() + SETLIST_WAIT_NS;
+        struct timespec until = {
+            .tv_sec = until_ns / 1000000000ULL,
+            .tv_nsec = until_ns % 1000000000ULL
+        };
+        pthread_cond_timedwait(&setlist.changed, &setlist.lock, &until);
+        waited = true;
+    }
+
+    const staged_score_t *score = &setlist.slots[piece % SETLIST_SLOTS];
+    bool ready = program_running && score->piece == piece && score->parts > 0;
+    uint64_t now = monotonic_time_ns();
+
+    if (ready) {
+        double lead_ms = waited ? 0.0 : (start_ns - score->staged_ns) / 1e6;
+        setlist.switches++;
+        setlist.lead_ms_total += lead_ms;
+        if (setlist.switches == 1 || lead_ms < setlist.lead_ms_min) {
+            setlist.lead_ms_min = lead_ms;
+        }
+    }
+    if (waited) {
+        setlist.waits++;
+        if (now - start_ns > setlist.wait_ns_max) {
+            setlist.wait_ns_max = now - start_ns;
+        }
+    }
+    pthread_mutex_unlock(&setlist.lock);
+
+    if (!ready) {
+        if (orchestra->verbose && program_running) {
+            printf("Conductor: Could not stage %s, ending the setlist\n", setlist.paths[piece]);
+        }
+        return -1;
+    }
+    if (orchestra->verbose) {
+        printf("\n=== Piece %d of %d: %s ===\n", piece + 1, setlist.length, setlist.paths[piece]);
+    }
+    return 0;
+}
+
+// A concert that stopped no longer holds back the preloader
+void leave_setlist(orchestra_t *orchestra) {
+    pthread_mutex_lock(&setlist.lock);
+    orchestra->piece = INT_MAX;
+    pthread_cond_broadcast(&setlist.changed);
+    pthread_mutex_unlock(&setlist.lock);
+}
+
+// Called by the musician before it plays a pulse, the first pulse of a new
+// piece starts its part from the top
+void follow_setlist(musician_t *musician, performance_t *performance, int sequence) {
+    int piece = sequence / MAX_PULSES;
+
+    if (piece == performance->piece) return;
+
+    assign_part(performance, musician->id, piece);
+    performance->piece = piece;
+    performance->note_index = 0;
+}
+
+// Pulse drift on the first pulse of each piece, to compare with every pulse's
+void record_piece_switch(uint64_t drift_ns) {
+    record_latency(&setlist.switch_drift, drift_ns / 1000.0);
+}
+
+void print_setlist_summary() {
+    pthread_mutex_lock(&setlist.lock);
+
+    printf("Setlist: %d pieces, %d switches, read in mean %.2f ms, staged mean %.0f ms before needed, min %.0f ms\n",
+           setlist.length, setlist.switches,
+           setlist.reads > 0 ? setlist.read_ms_total / setlist.reads : 0.0,
+           setlist.switches > 0 ? setlist.lead_ms_total / setlist.switches : 0.0,
+           setlist.lead_ms_min);
+    if (setlist.waits > 0) {
+        printf("Setlist: %d switches waited for their piece, max %.1f ms\n",
+               setlist.waits, setlist.wait_ns_max / 1e6);
+    }
+    if (setlist.switch_drift.count > 0) {
+        printf("Pulse drift on piece switches: mean %.1f us, max %.1f us\n",
+               setlist.switch_drift.total_us / setlist.switch_drift.count,
+               setlist.switch_drift.max_us);
+    }
+
+    pthread_mutex_unlock(&setlist.lock);
+}
@@ -0,0 +1,23 @@
+#ifndef SETLIST_H
+#define SETLIST_H
+
+#define MAX_SETLIST 64
+// Scores held at once: the piece playing, the one before it whose last
+// notes may still be sounding, and the next one being staged
+#define SETLIST_SLOTS 3
+// How often a conductor waiting for its next piece checks the run is still going
+#define SETLIST_WAIT_NS 100000000ULL
+
+int load_score(const char *filename);
+int load_setlist(const char *filename);
+int start_setlist(orchestra_t *orchestras, int count);
+void stop_setlist();
+int setlist_pulses();
+void assign_part(performance_t *performance, int musician_id, int piece);
+int begin_piece(orchestra_t *orchestra, int piece);
+void leave_setlist(orchestra_t *orchestra);
+void follow_setlist(musician_t *musician, performance_t *performance, int sequence);
+void record_piece_switch(uint64_t drift_ns);
+void print_setlist_summary();
+
+#endif
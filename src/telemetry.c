@@ -0,0 +1,293 @@
+#include <byzantine_orchestra.h>
+
+typedef struct {
+    latency_stat_t onset_lateness;
+    latency_stat_t pulse_drift;
+    latency_stat_t report_transit;
+    latency_stat_t tempo_lag;
+    latency_stat_t beat_latency;
+    latency_stat_t beat_close_time;
+    latency_stat_t checkpoint_snapshot;
+    latency_stat_t checkpoint_write;
+    uint64_t counters[COUNTER_COUNT];
+    // Messages sent over channels, and the pulses, reports or votes they carried
+    uint64_t wire_messages;
+    uint64_t wire_bytes;
+    uint64_t wire_items;
+    uint64_t concert_duration_ns;
+    // Played tempo against target, and how many pulses each concert's tempo
+    // changes took to settle
+    uint64_t tempo_beats;
+    double tempo_error_total;
+    double tempo_error_max;
+    int tempo_changes;
+    int converged_changes;
+    int convergence_pulses_total;
+    int convergence_pulses_max;
+} telemetry_t;
+
+static const char *counter_labels[COUNTER_COUNT] = {
+    "Reports on time",
+    "Reports after their beat closed",
+    "Reports too old to match a beat",
+    "Pulses sent",
+    "Musicians blacklisted",
+    "Musicians reinstated from probation",
+    "Reinstated musicians blacklisted again",
+    "Beats closed by quorum",
+    "Duplicate reports dropped",
+    "Pulses played after the conductor changed tempo",
+    "Musicians blacklisted on a change in their tempo",
+    "Pulses dropped by musicians still playing earlier ones",
+    "Votes dropped with the vote buffer full"
+};
+
+static telemetry_t telemetry;
+static pthread_mutex_t telemetry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void record_latency(latency_stat_t *stat, double latency_us) {
+    pthread_mutex_lock(&telemetry_mutex);
+
+    stat->count++;
+    stat->total_us += latency_us;
+    if (stat->count == 1 || latency_us > stat->max_us) {
+        stat->max_us = latency_us;
+    }
+
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+void record_onset_lateness(uint64_t lateness_ns) {
+    record_latency(&telemetry.onset_lateness, lateness_ns / 1000.0);
+}
+
+// How late the conductor sent each pulse relative to its tempo schedule
+void record_pulse_drift(uint64_t drift_ns) {
+    record_latency(&telemetry.pulse_drift, drift_ns / 1000.0);
+}
+
+// From the sender's header timestamp until the conductor received the report
+void record_report_transit(uint64_t transit_ns) {
+    record_latency(&telemetry.report_transit, transit_ns / 1000.0);
+}
+
+// From the conductor setting a tempo until the first pulse carrying it
+// reached a musician, once per musician and tempo
+void record_tempo_lag(uint64_t lag_ns) {
+    record_latency(&telemetry.tempo_lag, lag_ns / 1000.0);
+}
+
+// From a beat's nominal onset, one period after its pulse, until it closed.
+// Negative when the fastest musicians made up the quorum
+void record_beat_latency(int64_t latency_ns) {
+    record_latency(&telemetry.beat_latency, latency_ns / 1000.0);
+}
+
+// Conductor time spent closing a beat: votes, tempo and status
+void record_beat_close_time(uint64_t duration_ns) {
+    record_latency(&telemetry.beat_close_time, duration_ns / 1000.0);
+}
+
+// Conductor time spent copying the trust state for the checkpoint writer
+void record_checkpoint_snapshot(uint64_t duration_ns) {
+    record_latency(&telemetry.checkpoint_snapshot, duration_ns / 1000.0);
+}
+
+// Checkpoint writer time from CRC to the synced rename
+void record_checkpoint_write(uint64_t duration_ns) {
+    record_latency(&telemetry.checkpoint_write, duration_ns / 1000.0);
+}
+
+void record_wire_message(size_t bytes, int items) {
+    pthread_mutex_lock(&telemetry_mutex);
+    telemetry.wire_messages++;
+    telemetry.wire_bytes += bytes;
+    telemetry.wire_items += items;
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+// Wall time from the first pulse until every concert has ended
+void record_concert_duration(uint64_t duration_ns) {
+    pthread_mutex_lock(&telemetry_mutex);
+    // Adds up across resumed runs, like the counters
+    telemetry.concert_duration_ns += duration_ns;
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+// Called with telemetry_mutex held once the beats of a tempo change have closed
+static void close_tempo_window(tempo_window_t *window) {
+    if (window->change < 0) return;
+
+    telemetry.tempo_changes++;
+    if (window->settled_from >= 0) {
+        int pulses = window->settled_from - window->change + 1;
+        telemetry.converged_changes++;
+        telemetry.convergence_pulses_total += pulses;
+        if (pulses > telemetry.convergence_pulses_max) {
+            telemetry.convergence_pulses_max = pulses;
+        }
+    }
+
+    window->change = -1;
+    window->settled_from = -1;
+}
+
+// Called by a conductor in sequence order as each beat closes, with the
+// tempo its trusted musicians played
+void record_beat_tempo(tempo_window_t *window, int sequence, double played_bpm,
+                       double target_bpm, int change_sequence) {
+    double error = fabs(played_bpm - target_bpm) / target_bpm;
+
+    pthread_mutex_lock(&telemetry_mutex);
+
+    telemetry.tempo_beats++;
+    telemetry.tempo_error_total += error;
+    if (error > telemetry.tempo_error_max) {
+        telemetry.tempo_error_max = error;
+    }
+    window->error_total += error;
+    window->beats++;
+
+    if (change_sequence != window->change) {
+        close_tempo_window(window);
+        window->change = change_sequence;
+    }
+
+    if (window->change >= 0) {
+        if (error > BPM_TOLERANCE) {
+            window->settled_from = -1;
+        } else if (window->settled_from < 0) {
+            window->settled_from = sequence;
+        }
+    }
+
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+// Count the last tempo change of a concert once it has ended
+void finish_tempo_window(tempo_window_t *window) {
+    pthread_mutex_lock(&telemetry_mutex);
+    close_tempo_window(window);
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+void count_event(telemetry_counter_t counter) {
+    pthread_mutex_lock(&telemetry_mutex);
+    telemetry.counters[counter]++;
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+static void print_latency(const char *label, const latency_stat_t *stat) {
+    if (stat->count == 0) {
+        printf("%s: no samples\n", label);
+        return;
+    }
+
+    printf("%s: %llu samples, mean %.1f us, max %.1f us\n",
+           label, (unsigned long long) stat->count,
+           stat->total_us / stat->count, stat->max_us);
+}
+
+void print_telemetry_summary() {
+    pthread_mutex_lock(&telemetry_mutex);
+
+    printf("\nRun Summary\n");
+    // Onsets in musician processes are timed by their own copy of the telemetry
+    if (!process_mode) {
+        print_latency(executor_mode ? "Note onset lateness (timing wheel)" :
+                                      "Note onset lateness (per-thread timer)",
+                      &telemetry.onset_lateness);
+    }
+    print_latency("Pulse drift from tempo schedule", &telemetry.pulse_drift);
+    print_latency("Report transit to conductor", &telemetry.report_transit);
+    if (!process_mode) {
+        print_latency("Tempo propagation to musicians", &telemetry.tempo_lag);
+    }
+    print_latency(quorum_mode ? "Beat close after nominal onset (quorum)" :
+                                "Beat close after nominal onset (all reports)",
+                  &telemetry.beat_latency);
+    print_latency("Conductor beat close time", &telemetry.beat_close_time);
+    if (checkpoint_file != NULL) {
+        print_latency("Checkpoint snapshot by conductor", &telemetry.checkpoint_snapshot);
+        print_latency("Checkpoint write to disk", &telemetry.checkpoint_write);
+    }
+
+    print_deadline_summary();
+
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        printf("%s: %llu\n", counter_labels[i], (unsigned long long) telemetry.counters[i]);
+    }
+
+    uint64_t blacklisted = telemetry.counters[COUNTER_BLACKLISTED];
+    uint64_t reinstated = telemetry.counters[COUNTER_REINSTATED];
+    if (probation_streak > 0 && blacklisted > 0) {
+        printf("Probation: %.0f%% of blacklistings reinstated, %.0f%% of reinstatements blacklisted again\n",
+               100.0 * reinstated / blacklisted,
+               reinstated > 0 ? 100.0 * telemetry.counters[COUNTER_REBLACKLISTED] / reinstated : 0.0);
+    }
+
+    if (telemetry.concert_duration_ns > 0) {
+        double seconds = telemetry.concert_duration_ns / 1e9;
+        uint64_t reports = telemetry.counters[COUNTER_REPORTS_ON_TIME] +
+                           telemetry.counters[COUNTER_REPORTS_LATE];
+        printf("Throughput: %.1f reports/s, %.2f pulses/s over %.1f s\n",
+               reports / seconds, telemetry.counters[COUNTER_PULSES_SENT] / seconds, seconds);
+        if (concert_count > 1) {
+            printf("Concerts: %d played at once, %.2f concerts/s\n",
+                   concert_count, concert_count / seconds);
+        }
+    }
+
+    if (telemetry.tempo_beats > 0) {
+        printf("Tempo error from target (%s tracker): mean %.2f%%, max %.2f%% over %llu beats\n",
+               tempo_tracker_mode == TEMPO_TRACKER_KALMAN ? "kalman" : "average",
+               telemetry.tempo_error_total / telemetry.tempo_beats * 100.0,
+               telemetry.tempo_error_max * 100.0, (unsigned long long) telemetry.tempo_beats);
+    }
+    if (telemetry.tempo_changes > 0) {
+        printf("Tempo changes: %d, %d settled within %.0f%% of target after mean %.1f pulses, max %d\n",
+               telemetry.tempo_changes, telemetry.converged_changes, BPM_TOLERANCE * 100.0,
+               telemetry.converged_changes > 0 ?
+                   (double) telemetry.convergence_pulses_total / telemetry.converged_changes : 0.0,
+               telemetry.convergence_pulses_max);
+    }
+
+    // Every pulse and report used to be its own LEGACY_MESSAGE_BYTES message
+    uint64_t pulses = telemetry.counters[COUNTER_PULSES_SENT];
+    if (pulses > 0) {
+        printf("Wire traffic per pulse: %.1f messages, %.0f bytes (untagged format: %.1f messages, %.0f bytes)\n",
+               (double) telemetry.wire_messages / pulses,
+               (double) telemetry.wire_bytes / pulses,
+               (double) telemetry.wire_items / pulses,
+               (double) telemetry.wire_items * LEGACY_MESSAGE_BYTES / pulses);
+    }
+
+    pthread_mutex_unlock(&telemetry_mutex);
+
+    if (setlist_file != NULL) {
+        print_setlist_summary();
+    }
+    if (audio_sink != NULL) {
+        print_audio_summary();
+    }
+    if (adversary_benchmark) {
+        print_adversary_summary();
+    }
+}
+
+// Telemetry is checkpointed as an opaque block, so a resumed concert keeps counting
+size_t telemetry_state_size() {
+    return sizeof(telemetry_t);
+}
+
+void save_telemetry_state(void *state) {
+    pthread_mutex_lock(&telemetry_mutex);
+    memcpy(state, &telemetry, sizeof(telemetry));
+    pthread_mutex_unlock(&telemetry_mutex);
+}
+
+void restore_telemetry_state(const void *state) {
+    pthread_mutex_lock(&telemetry_mutex);
+    memcpy(&telemetry, state, sizeof(telemetry));
+    pthread_mutex_unlock(&telemetry_mutex);
+}
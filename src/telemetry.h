@@ -0,0 +1,56 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+typedef enum {
+    COUNTER_REPORTS_ON_TIME,
+    COUNTER_REPORTS_LATE,
+    COUNTER_REPORTS_STALE,
+    COUNTER_PULSES_SENT,
+    COUNTER_BLACKLISTED,
+    COUNTER_REINSTATED,
+    COUNTER_REBLACKLISTED,
+    COUNTER_QUORUM_CLOSES,
+    COUNTER_REPORTS_DUPLICATE,
+    COUNTER_TEMPO_SUPERSEDED,
+    COUNTER_CHANGES_DETECTED,
+    COUNTER_PULSES_DROPPED,
+    COUNTER_VOTES_DROPPED,
+    COUNTER_COUNT
+} telemetry_counter_t;
+
+typedef struct {
+    uint64_t count;
+    double total_us;
+    double max_us;
+} latency_stat_t;
+
+// Pulses after a concert's tempo change until it is within BPM_TOLERANCE of
+// the new target and stays there, and the concert's tempo error so far
+typedef struct {
+    int change; // Change whose beats are closing, or -1
+    int settled_from; // First beat of the current run within tolerance, or -1
+    double error_total;
+    int beats;
+} tempo_window_t;
+
+void record_latency(latency_stat_t *stat, double latency_us);
+void record_onset_lateness(uint64_t lateness_ns);
+void record_pulse_drift(uint64_t drift_ns);
+void record_report_transit(uint64_t transit_ns);
+void record_tempo_lag(uint64_t lag_ns);
+void record_beat_latency(int64_t latency_ns);
+void record_beat_close_time(uint64_t duration_ns);
+void record_checkpoint_snapshot(uint64_t duration_ns);
+void record_checkpoint_write(uint64_t duration_ns);
+void record_wire_message(size_t bytes, int items);
+void record_concert_duration(uint64_t duration_ns);
+void record_beat_tempo(tempo_window_t *window, int sequence, double played_bpm,
+                       double target_bpm, int change_sequence);
+void finish_tempo_window(tempo_window_t *window);
+void count_event(telemetry_counter_t counter);
+void print_telemetry_summary();
+size_t telemetry_state_size();
+void save_telemetry_state(void *state);
+void restore_telemetry_state(const void *state);
+
+#endif
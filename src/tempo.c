@@ -0,0 +1,42 @@
+#include <byzantine_orchestra.h>
+
+// Seqlock: the writer makes the version odd, writes the tempo and makes it
+// even again, and a reader retries until it copies the tempo between two
+// reads of the same even version. The fences keep the copy between the two
+// version accesses, and readers never block the conductor
+void write_tempo(tempo_record_t *record, const tempo_t *tempo) {
+    uint32_t version = record->version;
+
+    __atomic_store_n(&record->version, version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->tempo = *tempo;
+    __atomic_store_n(&record->version, version + 2, __ATOMIC_RELEASE);
+}
+
+tempo_t read_tempo(const tempo_record_t *record) {
+    tempo_t tempo;
+    uint32_t version;
+
+    do {
+        version = __atomic_load_n(&record->version, __ATOMIC_ACQUIRE);
+        tempo = record->tempo;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((version & 1) || version != __atomic_load_n(&record->version, __ATOMIC_RELAXED));
+
+    return tempo;
+}
+
+// Called only by the conductor. The next pulse carries the new tempo
+void set_concert_tempo(orchestra_t *orchestra, double bpm) {
+    if (bpm == orchestra->conductor_bpm) return;
+
+    tempo_t tempo = {
+        .bpm = bpm,
+        .epoch = orchestra->tempo.tempo.epoch + 1,
+        .sequence = orchestra->pulses_sent,
+        .set_ns = monotonic_time_ns()
+    };
+
+    orchestra->conductor_bpm = bpm;
+    write_tempo(&orchestra->tempo, &tempo);
+}
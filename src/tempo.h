@@ -0,0 +1,22 @@
+#ifndef TEMPO_H
+#define TEMPO_H
+
+// A tempo as the conductor set it
+typedef struct {
+    double bpm;
+    uint32_t epoch; // Tempo changes in the concert before this one
+    int sequence; // Pulse it was sent with, or the first to carry it
+    uint64_t set_ns; // When the conductor set it
+} tempo_t;
+
+// Written only by the conductor, read by any thread without a lock
+typedef struct {
+    uint32_t version; // Odd while being written
+    tempo_t tempo;
+} tempo_record_t;
+
+void write_tempo(tempo_record_t *record, const tempo_t *tempo);
+tempo_t read_tempo(const tempo_record_t *record);
+void set_concert_tempo(orchestra_t *orchestra, double bpm);
+
+#endif
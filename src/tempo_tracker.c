@@ -0,0 +1,46 @@
+#include <byzantine_orchestra.h>
+
+// Scalar Kalman filter over the orchestra's drift, the ratio of the tempo
+// musicians play to the tempo their pulse asked for, minus one. Each beat is
+// measured against its own pulse, so reports from pulses sent before a tempo
+// change cannot drag the new tempo back
+#define DRIFT_PROCESS_NOISE (0.002 * 0.002)
+#define DRIFT_INITIAL_VARIANCE (0.05 * 0.05)
+#define DRIFT_MIN_MEASUREMENT_NOISE (0.001 * 0.001)
+
+void initialize_tempo_tracker(tempo_tracker_t *tracker) {
+    tracker->drift_estimate = 0.0;
+    tracker->drift_variance = DRIFT_INITIAL_VARIANCE;
+}
+
+// ratio_mean and ratio_variance are over the trusted reports of one beat
+void tempo_tracker_observe(tempo_tracker_t *tracker, double ratio_mean,
+                           double ratio_variance, int count) {
+    if (count <= 0) return;
+
+    // Predict: the drift wanders a little every beat
+    tracker->drift_variance += DRIFT_PROCESS_NOISE;
+
+    // Update: a noisy or thinly reported beat counts for less
+    double measurement_noise = ratio_variance / count;
+    if (measurement_noise < DRIFT_MIN_MEASUREMENT_NOISE) {
+        measurement_noise = DRIFT_MIN_MEASUREMENT_NOISE;
+    }
+
+    double gain = tracker->drift_variance / (tracker->drift_variance + measurement_noise);
+    tracker->drift_estimate += gain * ((ratio_mean - 1.0) - tracker->drift_estimate);
+    tracker->drift_variance *= (1.0 - gain);
+}
+
+// Tempo to send so the orchestra plays at target once its drift is applied
+double tempo_tracker_command(const tempo_tracker_t *tracker, double target) {
+    double command = target / (1.0 + tracker->drift_estimate);
+
+    if (command < MIN_BPM) return MIN_BPM;
+    if (command > MAX_BPM) return MAX_BPM;
+    return command;
+}
+
+double tempo_tracker_drift(const tempo_tracker_t *tracker) {
+    return tracker->drift_estimate;
+}
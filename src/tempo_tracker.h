@@ -0,0 +1,16 @@
+#ifndef TEMPO_TRACKER_H
+#define TEMPO_TRACKER_H
+
+// Each concert's estimate of how its orchestra drifts from the tempo it is sent
+typedef struct {
+    double drift_estimate;
+    double drift_variance;
+} tempo_tracker_t;
+
+void initialize_tempo_tracker(tempo_tracker_t *tracker);
+void tempo_tracker_observe(tempo_tracker_t *tracker, double ratio_mean,
+                           double ratio_variance, int count);
+double tempo_tracker_command(const tempo_tracker_t *tracker, double target);
+double tempo_tracker_drift(const tempo_tracker_t *tracker);
+
+#endif
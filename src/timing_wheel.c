@@ -0,0 +1,252 @@
+#include <byzantine_orchestra.h>
+
+// Hierarchical timing wheel, each level covers WHEEL_SLOTS times the level below
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA ((1ULL << (WHEEL_LEVELS * WHEEL_SLOT_BITS)) - 1)
+
+typedef struct {
+    timer_entry_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t next_tick; // Next tick to expire
+    int pending_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    volatile bool running;
+} timing_wheel_t;
+
+static timing_wheel_t wheel;
+
+// Onset timers that expired on the current tick, dispatched together. Sized
+// for every executor task, each has a single onset timer
+static timer_entry_t **onset_batch = NULL;
+
+static uint64_t ns_to_tick(uint64_t ns) {
+    // Round up so no timer expires early
+    return (ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+static uint64_t current_tick() {
+    return monotonic_time_ns() / WHEEL_TICK_NS;
+}
+
+int initialize_timing_wheel(int onset_capacity) {
+    if (onset_capacity > 0) {
+        onset_batch = malloc(sizeof(*onset_batch) * onset_capacity);
+        if (onset_batch == NULL) {
+            perror("Could not allocate onset batch");
+            return -1;
+        }
+    }
+
+    memset(wheel.slots, 0, sizeof(wheel.slots));
+    wheel.next_tick = current_tick();
+    wheel.pending_count = 0;
+    wheel.running = true;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&wheel.lock, NULL);
+    pthread_cond_init(&wheel.wake, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    if (start_thread(&wheel.thread, NULL, timer_thread, NULL) != 0) {
+        perror("Could not create timer thread");
+        wheel.running = false;
+        free(onset_batch);
+        onset_batch = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void shutdown_timing_wheel() {
+    if (!wheel.running) return;
+
+    pthread_mutex_lock(&wheel.lock);
+    wheel.running = false;
+    pthread_cond_signal(&wheel.wake);
+    pthread_mutex_unlock(&wheel.lock);
+
+    if (join_thread(wheel.thread, "Timer") != 0) {
+        return;
+    }
+    pthread_cond_destroy(&wheel.wake);
+    pthread_mutex_destroy(&wheel.lock);
+    free(onset_batch);
+    onset_batch = NULL;
+}
+
+// Slot list helpers, called with wheel.lock held
+
+static void link_entry(timer_entry_t *entry) {
+    uint64_t delta = entry->expires_tick < wheel.next_tick ?
+                     0 : entry->expires_tick - wheel.next_tick;
+    uint64_t tick = entry->expires_tick;
+
+    if (entry->expires_tick < wheel.next_tick) {
+        tick = wheel.next_tick;
+    } else if (delta > WHEEL_MAX_DELTA) {
+        tick = wheel.next_tick + WHEEL_MAX_DELTA;
+        delta = WHEEL_MAX_DELTA;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= (1ULL << ((level + 1) * WHEEL_SLOT_BITS))) {
+        level++;
+    }
+
+    int slot = (tick >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK;
+    timer_entry_t **head = &wheel.slots[level][slot];
+
+    entry->next = *head;
+    entry->pprev = head;
+    if (*head != NULL) {
+        (*head)->pprev = &entry->next;
+    }
+    *head = entry;
+}
+
+static void unlink_entry(timer_entry_t *entry) {
+    *entry->pprev = entry->next;
+    if (entry->next != NULL) {
+        entry->next->pprev = entry->pprev;
+    }
+}
+
+// Move the entries of a higher level slot down now that they are closer
+static void cascade(int level, int slot) {
+    timer_entry_t *entry = wheel.slots[level][slot];
+    wheel.slots[level][slot] = NULL;
+
+    while (entry != NULL) {
+        timer_entry_t *next = entry->next;
+        link_entry(entry);
+        entry = next;
+    }
+}
+
+void schedule_timer(timer_entry_t *entry, uint64_t due_ns) {
+    pthread_mutex_lock(&wheel.lock);
+
+    if (entry->pending) {
+        unlink_entry(entry);
+        wheel.pending_count--;
+    }
+
+    // An idle wheel can skip straight to the present
+    if (wheel.pending_count == 0) {
+        uint64_t now_tick = current_tick();
+        if (now_tick > wheel.next_tick) {
+            wheel.next_tick = now_tick;
+        }
+    }
+
+    entry->expires_tick = ns_to_tick(due_ns);
+    entry->pending = true;
+    link_entry(entry);
+
+    if (wheel.pending_count++ == 0) {
+        pthread_cond_signal(&wheel.wake);
+    }
+
+    pthread_mutex_unlock(&wheel.lock);
+}
+
+void cancel_timer(timer_entry_t *entry) {
+    pthread_mutex_lock(&wheel.lock);
+
+    if (entry->pending) {
+        unlink_entry(entry);
+        entry->pending = false;
+        wheel.pending_count--;
+    }
+
+    pthread_mutex_unlock(&wheel.lock);
+}
+
+// Expire one tick, returns the number of onsets added to the batch
+static int expire_tick(int batch_count) {
+    int slot = wheel.next_tick & WHEEL_SLOT_MASK;
+
+    // Cascade from each level whose lower level just wrapped around
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if ((wheel.next_tick >> ((level - 1) * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK) {
+            break;
+        }
+        cascade(level, (wheel.next_tick >> (level * WHEEL_SLOT_BITS)) & WHEEL_SLOT_MASK);
+    }
+
+    timer_entry_t *entry = wheel.slots[0][slot];
+    wheel.slots[0][slot] = NULL;
+
+    while (entry != NULL) {
+        timer_entry_t *next = entry->next;
+
+        entry->pending = false;
+        wheel.pending_count--;
+
+        if (entry->kind == TIMER_NOTE_ONSET) {
+            onset_batch[batch_count++] = entry;
+        } else if (entry->kind == TIMER_REPORT_DEADLINE) {
+            MsgSendPulse(entry->coid, -1, PULSE_CODE_REPORT_DEADLINE, entry->id);
+        }
+
+        entry = next;
+    }
+
+    wheel.next_tick++;
+    return batch_count;
+}
+
+void* timer_thread(void *arg) {
+    (void) arg;
+    profile_thread(ROLE_TIMER);
+
+    pthread_mutex_lock(&wheel.lock);
+
+    while (wheel.running) {
+        // Every wake, the wheel ticks whether or not anything expires
+        sample_thread_cpu(NULL);
+
+        if (wheel.pending_count == 0) {
+            pthread_cond_wait(&wheel.wake, &wheel.lock);
+            continue;
+        }
+
+        uint64_t now_tick = current_tick();
+
+        if (wheel.next_tick > now_tick) {
+            uint64_t due = wheel.next_tick * WHEEL_TICK_NS;
+            struct timespec deadline = {
+                .tv_sec = due / 1000000000ULL,
+                .tv_nsec = due % 1000000000ULL
+            };
+            pthread_cond_timedwait(&wheel.wake, &wheel.lock, &deadline);
+            continue;
+        }
+
+        int batch_count = 0;
+        while (wheel.next_tick <= now_tick && wheel.pending_count > 0) {
+            batch_count = expire_tick(batch_count);
+        }
+        if (wheel.pending_count == 0 && wheel.next_tick <= now_tick) {
+            wheel.next_tick = now_tick + 1;
+        }
+
+        // Hand the whole batch to the executor outside the wheel lock
+        if (batch_count > 0) {
+            pthread_mutex_unlock(&wheel.lock);
+            executor_dispatch_onsets(onset_batch, batch_count);
+            pthread_mutex_lock(&wheel.lock);
+        }
+    }
+
+    pthread_mutex_unlock(&wheel.lock);
+    return NULL;
+}
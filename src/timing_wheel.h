@@ -0,0 +1,25 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+typedef enum {
+    TIMER_NOTE_ONSET,
+    TIMER_REPORT_DEADLINE
+} timer_kind_t;
+
+typedef struct timer_entry {
+    struct timer_entry *next;
+    struct timer_entry **pprev; // Points at whatever points at this entry
+    uint64_t expires_tick;
+    timer_kind_t kind;
+    int id; // Pulse sequence for report deadlines
+    int coid; // Conductor pulsed at a report deadline
+    bool pending;
+} timer_entry_t;
+
+int initialize_timing_wheel(int onset_capacity);
+void shutdown_timing_wheel();
+void schedule_timer(timer_entry_t *entry, uint64_t due_ns);
+void cancel_timer(timer_entry_t *entry);
+void* timer_thread(void *arg);
+
+#endif
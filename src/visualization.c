@@ -1,19 +1,31 @@
 #include <byzantine_orchestra.h>
 
-typedef struct {
-    char note[20];
-    double bpm;
-    double timestamp;
-    int musician_id;
-    bool was_blacklisted;
-} note_event_t;
-
-typedef struct {
-    note_event_t events[MAX_HISTORY];
-    int count;
-    double start_time;
-    double max_deviation_percent;
-} visualization_t;
+// Columns per second of concert, so the display spans VIZ_WINDOW_SECONDS
+#define COLUMNS_PER_SECOND ((double)(DISPLAY_WIDTH - 1) / VIZ_WINDOW_SECONDS)
+// Longest note name drawn, its text runs ahead of the newest column
+#define NOTE_TEXT_MAX 19
+// Columns kept in the ring, the display plus room for text drawn ahead of it
+#define RASTER_WIDTH (DISPLAY_WIDTH + NOTE_TEXT_MAX)
+
+// The display as a ring of columns indexed by column % RASTER_WIDTH. Each
+// note is drawn into it once when it arrives, and scrolling only clears the
+// columns coming into view, so a frame costs the notes since the last one
+struct raster {
+    char cells[DISPLAY_HEIGHT][RASTER_WIDTH];
+    int colours[DISPLAY_HEIGHT][RASTER_WIDTH]; // Musician drawn in the cell, -1 if none
+    long newest_column; // Column of the latest note or frame
+    long cleared_column; // Columns up to this one hold no older notes
+    long last_column[MAX_MUSICIANS];
+    int last_y[MAX_MUSICIANS];
+    bool has_last_pos[MAX_MUSICIANS];
+    uint64_t start_ns;
+    bool dirty; // Notes drawn since the last frame
+    // CPU usage at the last frame, the legend shows what was used since
+    uint64_t legend_ns;
+    cpu_usage_t legend_roles[ROLE_COUNT];
+    cpu_usage_t legend_musicians[MAX_MUSICIANS];
+};
+typedef struct raster raster_t;
 
 // ANSI escape codes for distinct musician colours
 const char *COLOURS[] = {
@@ -29,78 +41,228 @@ const char *COLOURS[] = {
 const char *BLACKLIST_COLOUR = "\033[38;5;252m"; //  Grey
 const char *RESET_COLOUR = "\033[0m";
 
-visualization_t viz = { 0 };
 volatile bool viz_running = true;
 
-void play_note_with_viz(musician_t *musician) {
-    play_note(musician);
+// One concert is drawn, the others have no raster. Frames are drawn when
+// notes arrive, on a condition variable so shutdown can wake the thread.
+// viz_lock also guards the raster
+static pthread_t viz_thread;
+static bool viz_started = false;
+static pthread_mutex_t viz_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t viz_wake;
+
+void play_note_with_viz(musician_t *musician, int sequence) {
+    play_note(musician->orchestra, musician, sequence);
 }
 
-int initialize_visualization() {
-    viz.count = 0;
-    viz.max_deviation_percent = BYZANTINE_MAX_DEVIATION * 100;
-    viz.start_time = time(NULL);
+int initialize_visualization(orchestra_t *orchestra) {
+    raster_t *raster = malloc(sizeof(*raster));
+    if (raster == NULL) {
+        perror("Could not allocate visualization");
+        return -1;
+    }
+
+    memset(raster->cells, ' ', sizeof(raster->cells));
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < RASTER_WIDTH; x++) {
+            raster->colours[y][x] = -1;
+        }
+    }
+    raster->newest_column = 0;
+    raster->cleared_column = RASTER_WIDTH - 1;
+    for (int i = 0; i < MAX_MUSICIANS; i++) {
+        raster->has_last_pos[i] = false;
+    }
+    raster->start_ns = monotonic_time_ns();
+    raster->dirty = false;
+
+    orchestra->raster = raster;
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&viz_wake, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
 
-    pthread_t viz_thread;
-    if (pthread_create(&viz_thread, NULL, visualization_thread, NULL) != 0) {
+    if (start_thread(&viz_thread, NULL, visualization_thread, orchestra) != 0) {
         perror("Could not create visualization thread");
+        pthread_cond_destroy(&viz_wake);
         return -1;
     }
-    pthread_detach(viz_thread);
+    viz_started = true;
 
     return 0;
 }
 
-void add_note_event(const char *note, double bpm, int musician_id) {
-    // If history is full, shift events to make room for new event
-    if (viz.count >= MAX_HISTORY) {
-        memmove(viz.events, viz.events + 1,
-                sizeof(note_event_t) * (MAX_HISTORY - 1));
-        viz.count = MAX_HISTORY - 1;
+// Stop drawing and join the thread, so nothing is drawn over the summary
+void shutdown_visualization() {
+    pthread_mutex_lock(&viz_lock);
+    viz_running = false;
+    if (viz_started) {
+        pthread_cond_signal(&viz_wake);
+    }
+    pthread_mutex_unlock(&viz_lock);
+
+    if (!viz_started || join_thread(viz_thread, "Visualization") != 0) {
+        return;
+    }
+
+    viz_started = false;
+    pthread_cond_destroy(&viz_wake);
+}
+
+// Called once nothing can add notes to the concert any more
+void release_visualization(orchestra_t *orchestra) {
+    free(orchestra->raster);
+    orchestra->raster = NULL;
+}
+
+// Raster helpers, called with viz_lock held
+
+static long oldest_visible_column(const raster_t *raster) {
+    long column = raster->newest_column - (DISPLAY_WIDTH - 1);
+    return column > 0 ? column : 0;
+}
+
+// Blank the ring slots of every column up to this one not yet cleared
+static void clear_columns_through(raster_t *raster, long column) {
+    if (column <= raster->cleared_column) return;
+
+    // After a long silence every slot is cleared once
+    long from = raster->cleared_column + 1;
+    if (column - from >= RASTER_WIDTH) {
+        from = column - RASTER_WIDTH + 1;
+    }
+
+    for (long c = from; c <= column; c++) {
+        int x = c % RASTER_WIDTH;
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+            raster->cells[y][x] = ' ';
+            raster->colours[y][x] = -1;
+        }
+    }
+    raster->cleared_column = column;
+}
+
+static void scroll_to(raster_t *raster, long column) {
+    if (column <= raster->newest_column) return;
+
+    clear_columns_through(raster, column);
+    raster->newest_column = column;
+}
+
+void add_note_event(orchestra_t *orchestra, const char *note, double bpm, int musician_id) {
+    raster_t *raster = orchestra->raster;
+
+    // Only the principal of each part of the drawn concert is drawn
+    if (raster == NULL || musician_id >= MAX_MUSICIANS) return;
+
+    pthread_mutex_lock(&viz_lock);
+
+    double elapsed_seconds = (monotonic_time_ns() - raster->start_ns) / 1e9;
+    long x = map_time_to_x(elapsed_seconds);
+    int y = map_bpm_to_y(bpm, MIN_BPM - 20, MAX_BPM + 20);
+    scroll_to(raster, x);
+
+    // Draw connecting line including old notes from before blacklisting
+    if (raster->has_last_pos[musician_id]) {
+        draw_musician_line(raster, raster->last_column[musician_id], raster->last_y[musician_id],
+                x, y, musician_id);
     }
 
-    // Store the new note event
-    strncpy(viz.events[viz.count].note, note,
-            sizeof(viz.events[viz.count].note) - 1);
-    viz.events[viz.count].note[sizeof(viz.events[viz.count].note) - 1] = '\0';
-    viz.events[viz.count].bpm = bpm;
-    viz.events[viz.count].timestamp = time(NULL) - viz.start_time;
-    viz.events[viz.count].musician_id = musician_id;
-    viz.events[viz.count].was_blacklisted = musicians[musician_id].is_blacklisted;
+    // Update last position
+    raster->last_column[musician_id] = x;
+    raster->last_y[musician_id] = y;
+    raster->has_last_pos[musician_id] = true;
+
+    // Display note, its text runs into columns still to scroll into view
+    size_t length = strnlen(note, NOTE_TEXT_MAX);
+    clear_columns_through(raster, x + (long) length - 1);
+    for (size_t j = 0; j < length; j++) {
+        int px = (x + (long) j) % RASTER_WIDTH;
+        raster->cells[y][px] = note[j];
+        raster->colours[y][px] = musician_id;
+    }
 
-    viz.count++;
+    raster->dirty = true;
+    if (viz_started) {
+        pthread_cond_signal(&viz_wake);
+    }
+    pthread_mutex_unlock(&viz_lock);
 }
 
 void* visualization_thread(void *arg) {
+    orchestra_t *orchestra = (orchestra_t*) arg;
+    raster_t *raster = orchestra->raster;
+    uint64_t next_frame_ns = monotonic_time_ns();
+    profile_thread(ROLE_VISUALIZER);
+
+    pthread_mutex_lock(&viz_lock);
     while (viz_running && program_running) {
+        // Nothing to draw until a note arrives
+        if (!raster->dirty) {
+            pthread_cond_wait(&viz_wake, &viz_lock);
+            continue;
+        }
+
+        // Notes arriving together share a frame, at most one per refresh interval
+        struct timespec deadline = {
+            .tv_sec = next_frame_ns / 1000000000ULL,
+            .tv_nsec = next_frame_ns % 1000000000ULL
+        };
+        int waited = 0;
+        while (viz_running && program_running && waited != ETIMEDOUT &&
+               monotonic_time_ns() < next_frame_ns) {
+            waited = pthread_cond_timedwait(&viz_wake, &viz_lock, &deadline);
+        }
+        if (!viz_running || !program_running) break;
+
+        // Notes stay in the raster for the first frame after the beat recovers
+        if (should_shed(orchestra, SHED_FRAMES)) {
+            next_frame_ns = monotonic_time_ns() + REFRESH_INTERVAL_MS * 1000000ULL;
+            continue;
+        }
+
+        raster->dirty = false;
+        pthread_mutex_unlock(&viz_lock);
+
+        uint64_t frame_ns = monotonic_time_ns();
         printf("\033[2J\033[H"); // Clear screen, move cursor to top left
-        draw_visualization(target_bpm, time(NULL) - viz.start_time);
-        usleep(REFRESH_INTERVAL_MS * 1000); // Wait before next frame
+        draw_visualization(orchestra, (frame_ns - raster->start_ns) / 1e9);
+        sample_thread_cpu(NULL);
+        next_frame_ns = frame_ns + REFRESH_INTERVAL_MS * 1000000ULL;
+
+        pthread_mutex_lock(&viz_lock);
     }
     viz_running = false;
+    pthread_mutex_unlock(&viz_lock);
     return NULL;
 }
 
-void draw_musician_line(char display[DISPLAY_HEIGHT][DISPLAY_WIDTH + 1],
-        int colour_map[DISPLAY_HEIGHT][DISPLAY_WIDTH], int x1, int y1, int x2,
-        int y2, int musician_id) {
+// Called with viz_lock held, only plots columns still in view
+void draw_musician_line(raster_t *raster, long x1, int y1, long x2, int y2, int musician_id) {
+    long first_column = oldest_visible_column(raster);
+
     // Absolute differences in x and y
-    int delta_x = abs(x2 - x1);
+    long delta_x = labs(x2 - x1);
     int delta_y = abs(y2 - y1);
 
     // Which direction to step in x and y
     int step_x = (x1 < x2) ? 1 : -1;
     int step_y = (y1 < y2) ? 1 : -1;
 
-    int error = delta_x - delta_y; // Initial error value for Bresenham's algorithm
+    long error = delta_x - delta_y; // Initial error value for Bresenham's algorithm
 
     while (true) {
         // Check is within bounds and is an overwritable character
-        if (x1 >= 0 && x1 < DISPLAY_WIDTH && y1 >= 0 && y1 < DISPLAY_HEIGHT
-                && (display[y1][x1] == ' ' || display[y1][x1] == '.')) {
-            display[y1][x1] = '.';
-            if (colour_map[y1][x1] == -1) {
-                colour_map[y1][x1] = musician_id; // Assign colour only if unset
+        if (x1 >= first_column && x1 <= raster->cleared_column &&
+                y1 >= 0 && y1 < DISPLAY_HEIGHT) {
+            int x = x1 % RASTER_WIDTH;
+            if (raster->cells[y1][x] == ' ' || raster->cells[y1][x] == '.') {
+                raster->cells[y1][x] = '.';
+                if (raster->colours[y1][x] == -1) {
+                    raster->colours[y1][x] = musician_id; // Assign colour only if unset
+                }
             }
         }
 
@@ -108,7 +270,7 @@ void draw_musician_line(char display[DISPLAY_HEIGHT][DISPLAY_WIDTH + 1],
             break;
 
         // Bresenham's algorithm to connect the two points
-        int double_error = 2 * error;
+        long double_error = 2 * error;
         if (double_error > -delta_y) {
             error -= delta_y;
             x1 += step_x;
@@ -122,13 +284,9 @@ void draw_musician_line(char display[DISPLAY_HEIGHT][DISPLAY_WIDTH + 1],
 
 // Plotting helpers
 
-int map_time_to_x(double t, double start_time, int display_time_range,
-        int stretch_factor) {
-    double visible_duration = display_time_range * stretch_factor;
-    double time_offset = t - start_time;
-    double normalized_time = time_offset / visible_duration;
-    int x = (int) (normalized_time * (DISPLAY_WIDTH - 1) * stretch_factor);
-    return x;
+// Column of a time since the concert started, counted from its first column
+long map_time_to_x(double t) {
+    return (long) (t * COLUMNS_PER_SECOND);
 }
 
 int map_bpm_to_y(double bpm, double min_bpm, double max_bpm) {
@@ -141,25 +299,49 @@ int map_bpm_to_y(double bpm, double min_bpm, double max_bpm) {
     return y;
 }
 
-void draw_visualization(double target_bpm, double elapsed_seconds) {
-    int display_time_range = 20;
-    double start_time = elapsed_seconds - display_time_range;
-    if (start_time < 0)
-        start_time = 0;
-
-    int stretch_factor = 2;
+void draw_visualization(const orchestra_t *orchestra, double elapsed_seconds) {
+    const musician_t *musicians = orchestra->musicians;
+    const standing_t *standings = orchestra->standings;
+    raster_t *raster = orchestra->raster;
     double min_bpm = MIN_BPM - 20;
     double max_bpm = MAX_BPM + 20;
 
-    printf("QNX Byzantine Orchestra - BPM: %.1f\n", conductor_bpm);
+    printf("QNX Byzantine Orchestra - BPM: %.1f\n", read_tempo(&orchestra->tempo).bpm);
+
+    int legend_count = orchestra->num_musicians < MAX_MUSICIANS ?
+                       orchestra->num_musicians : MAX_MUSICIANS;
+
+    // CPU shares are of one core since the last frame
+    uint64_t now_ns = monotonic_time_ns();
+    double interval_ns = raster->legend_ns > 0 ? (double)(now_ns - raster->legend_ns) : 0.0;
+    cpu_usage_t roles[ROLE_COUNT];
+    int role_threads[ROLE_COUNT];
+    role_cpu_usage(roles, role_threads);
+
+    printf("CPU:");
+    for (int r = 0; r < ROLE_COUNT; r++) {
+        if (role_threads[r] == 0) continue;
+
+        printf(" %s %.1f%%", role_name(r), interval_ns > 0 ?
+               100.0 * (roles[r].cpu_ns - raster->legend_roles[r].cpu_ns) / interval_ns : 0.0);
+        if (context_switches_counted()) {
+            printf(" (%llu/%llu cs)",
+                   (unsigned long long)(roles[r].voluntary_switches -
+                                        raster->legend_roles[r].voluntary_switches),
+                   (unsigned long long)(roles[r].involuntary_switches -
+                                        raster->legend_roles[r].involuntary_switches));
+        }
+        raster->legend_roles[r] = roles[r];
+    }
+    printf("\n");
 
     // Print legend with reputation scores and blacklist status
-    for (int i = 0; i < num_musicians; i++) {
+    for (int i = 0; i < legend_count; i++) {
         const char *musician_name = musician_names[i];
         const char *status = "";
         const char *colour = COLOURS[i % (sizeof(COLOURS) / sizeof(COLOURS[0]))];
 
-        if (musicians[i].is_blacklisted) {
+        if (standings[i].is_blacklisted) {
             status = "[BLACKLISTED]";
             colour = BLACKLIST_COLOUR;
         } else if (musicians[i].is_byzantine && musicians[i].is_first_chair) {
@@ -170,58 +352,46 @@ void draw_visualization(double target_bpm, double elapsed_seconds) {
             status = "[BYZANTINE]";
         }
 
-        printf("%s%s%s %s (%.1f rep)%s  ",
-               colour, musician_name, RESET_COLOUR, status,
-               musicians[i].reputation, RESET_COLOUR);
+        // Musician processes keep their own CPU counts
+        cpu_usage_t usage;
+        musician_cpu_usage(&orchestra->performances[i], &usage);
+        cpu_usage_t *last = &raster->legend_musicians[i];
+
+        printf("%s%s%s %s (%.1f rep", colour, musician_name, RESET_COLOUR, status,
+               musician_reputation(orchestra, i));
+        if (!process_mode) {
+            printf(", %.1f%% cpu", interval_ns > 0 ?
+                   100.0 * (usage.cpu_ns - last->cpu_ns) / interval_ns : 0.0);
+        }
+        if (!process_mode && context_switches_counted()) {
+            printf(", %llu/%llu cs",
+                   (unsigned long long)(usage.voluntary_switches - last->voluntary_switches),
+                   (unsigned long long)(usage.involuntary_switches - last->involuntary_switches));
+        }
+        printf(")%s  ", RESET_COLOUR);
+        *last = usage;
     }
     printf("\n");
+    raster->legend_ns = now_ns;
 
     char display[DISPLAY_HEIGHT][DISPLAY_WIDTH + 1];
     int colour_map[DISPLAY_HEIGHT][DISPLAY_WIDTH];
 
-    // Initialize display and colour map
+    // Scroll to now and copy the columns in view, split where the ring wraps
+    pthread_mutex_lock(&viz_lock);
+    scroll_to(raster, map_time_to_x(elapsed_seconds));
+    long first_column = oldest_visible_column(raster);
+    int first = first_column % RASTER_WIDTH;
+    int before_wrap = RASTER_WIDTH - first < DISPLAY_WIDTH ? RASTER_WIDTH - first : DISPLAY_WIDTH;
     for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH; x++) {
-            display[y][x] = ' ';
-            colour_map[y][x] = -1;
-        }
+        memcpy(display[y], &raster->cells[y][first], before_wrap);
+        memcpy(display[y] + before_wrap, raster->cells[y], DISPLAY_WIDTH - before_wrap);
+        memcpy(colour_map[y], &raster->colours[y][first], sizeof(int) * before_wrap);
+        memcpy(colour_map[y] + before_wrap, raster->colours[y],
+               sizeof(int) * (DISPLAY_WIDTH - before_wrap));
         display[y][DISPLAY_WIDTH] = '\0';
     }
-
-    int last_x[MAX_MUSICIANS];
-    int last_y[MAX_MUSICIANS];
-    bool has_last_pos[MAX_MUSICIANS] = { false };
-
-    for (int i = 0; i < viz.count; i++) {
-        double t = viz.events[i].timestamp;
-        if (t < start_time) // Skip events outside display window
-            continue;
-
-        // Calculate positions
-        int x = map_time_to_x(t, start_time, display_time_range, stretch_factor);
-        int y = map_bpm_to_y(viz.events[i].bpm, min_bpm, max_bpm);
-        int m_id = viz.events[i].musician_id;
-
-        // Draw connecting line including old notes from before blacklisting
-        if (has_last_pos[m_id]) {
-            draw_musician_line(display, colour_map, last_x[m_id], last_y[m_id],
-                    x, y, m_id);
-        }
-
-        // Update last position
-        last_x[m_id] = x;
-        last_y[m_id] = y;
-        has_last_pos[m_id] = true;
-
-        // Display note
-        for (int j = 0; j < strlen(viz.events[i].note); j++) {
-            int px = x + j;
-            if (px < DISPLAY_WIDTH) {
-                display[y][px] = viz.events[i].note[j];
-                colour_map[y][px] = m_id;
-            }
-        }
-    }
+    pthread_mutex_unlock(&viz_lock);
 
     // Print display
     for (int y = 0; y < DISPLAY_HEIGHT; y++) {
@@ -234,7 +404,7 @@ void draw_visualization(double target_bpm, double elapsed_seconds) {
 
             if (m_id >= 0) {
 
-                const char *colour = musicians[m_id].is_blacklisted ?
+                const char *colour = standings[m_id].is_blacklisted ?
                     BLACKLIST_COLOUR :
                     COLOURS[m_id % (sizeof(COLOURS) / sizeof(COLOURS[0]))];
 
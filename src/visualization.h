@@ -1,16 +1,18 @@
 #ifndef VISUALIZATION_H
 #define VISUALIZATION_H
 
-int initialize_visualization();
-void add_note_event(const char* note, double bpm, int musician_id);
-void play_note_with_viz(musician_t *musician);
+// A concert's display, private to visualization.c
+struct raster;
+
+int initialize_visualization(orchestra_t *orchestra);
+void shutdown_visualization();
+void release_visualization(orchestra_t *orchestra);
+void add_note_event(orchestra_t *orchestra, const char* note, double bpm, int musician_id);
+void play_note_with_viz(musician_t *musician, int sequence);
 void* visualization_thread(void *arg);
-void draw_musician_line(char display[DISPLAY_HEIGHT][DISPLAY_WIDTH + 1],
-        int colour_map[DISPLAY_HEIGHT][DISPLAY_WIDTH],
-        int x1, int y1, int x2, int y2,
-        int musician_id);
-int map_time_to_x(double t, double start_time, int display_time_range, int stretch_factor);
+void draw_musician_line(struct raster *raster, long x1, int y1, long x2, int y2, int musician_id);
+long map_time_to_x(double t);
 int map_bpm_to_y(double bpm, double min_bpm, double max_bpm);
-void draw_visualization(double target_bpm, double elapsed_seconds);
+void draw_visualization(const orchestra_t *orchestra, double elapsed_seconds);
 
 #endif